@@ -0,0 +1,14 @@
+#ifndef HUEMASTER_ALLOCATION_COUNTER_H
+#define HUEMASTER_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Counts the heap allocations made on the calling thread. The count is taken in malloc itself (including calloc,
+// realloc and the aligned forms), so it covers operator new in all its forms as well as OpenCV's cv::fastMalloc.
+// The counter is per thread, so counting adds no shared state between worker threads.
+class AllocationCounter {
+public:
+    static std::uint64_t thread_allocations();
+};
+
+#endif //HUEMASTER_ALLOCATION_COUNTER_H
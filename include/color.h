@@ -2,7 +2,9 @@
 #define HUEMASTER_COLOR_H
 
 #include <string>
-#include <opencv2/opencv.hpp>
+#include <string_view>
+#include <vector>
+#include "vec3.h"
 
 class Color {
 private:
@@ -22,8 +24,8 @@ private:
 
 public:
     Color() = default;
-    explicit Color(const cv::Vec3f &color);
-    Color(const cv::Vec3f &color, float proportion);
+    explicit Color(const Vec3f &color);
+    Color(const Vec3f &color, float proportion);
 
     [[nodiscard]] float calculate_luminance() const;
     [[nodiscard]] float calculate_luminance_difference(float other_luminance) const;
@@ -40,24 +42,50 @@ public:
     void adjust_alpha(float amount);
     void adjust_hue(float target_hue);
 
-    static bool is_valid_format(const std::string &format_name);
-    void set_format(const std::string &format_name);
+    static bool is_valid_format(std::string_view format_name);
+    bool set_format(std::string_view format_name);
 
-    [[nodiscard]] cv::Vec3f get_color() const;
+    [[nodiscard]] Vec3f get_color() const;
+    [[nodiscard]] Vec3f get_lab() const;
     [[nodiscard]] float get_proportion() const;
 
     [[nodiscard]] std::string to_string() const;
+    void append_to(std::string &output) const;
 
     [[nodiscard]] Color multiply(float amount);
 
+    static Color from_hex(const std::string &hex);
+    static Color interpolate(const Color &from, const Color &to, float amount);
+
+#ifndef HUEMASTER_LITE_IMAGE
+    // OpenCV builds convert through cv::cvtColor; while one of these is alive they use the in-tree math of the lite
+    // build instead, and the previous setting comes back when it goes out of scope (exceptions included).
+    class InTreeColorSpaceScope {
+    public:
+        InTreeColorSpaceScope();
+        ~InTreeColorSpaceScope();
+
+        InTreeColorSpaceScope(const InTreeColorSpaceScope &) = delete;
+        InTreeColorSpaceScope &operator=(const InTreeColorSpaceScope &) = delete;
+
+    private:
+        bool previous;
+    };
+#endif
+
 private:
-    static cv::Vec3f normalize_color(const cv::Vec3f &color);
+    static Vec3f normalize_color(const Vec3f &color);
     static float normalize_channel(float channel);
 
-    std::string to_hex() const;
-    std::string to_rgb() const;
+    static Vec3f to_hls(const Vec3f &color);
+    static Vec3f from_hls(const Vec3f &hls_color);
+    static Vec3f to_lab(const Vec3f &color);
+    static Vec3f from_lab(const Vec3f &lab_color);
+
+    void append_hex(std::string &output) const;
+    void append_rgb(std::string &output) const;
 
-    cv::Vec3f color;
+    Vec3f color;
     float alpha = 1.0f;
     StringFormat format{};
     float proportion{};
@@ -1,6 +1,7 @@
 #ifndef HUEMASTER_COLOR_SCHEME_H
 #define HUEMASTER_COLOR_SCHEME_H
 
+#include <string_view>
 #include "image.h"
 
 class ColorScheme {
@@ -8,29 +9,41 @@ public:
     ColorScheme();
 
     void generate(const Image &image);
+    void generate(const std::vector<Color> &colors, bool light);
+    void reset();
 
     void print_Xresources();
 
+    void append_dump(std::string &output) const;
+    static ColorScheme from_dump(const std::string &dump);
+    static ColorScheme interpolate(const ColorScheme &from, const ColorScheme &to, float amount);
+
     struct ConversionResult {
         bool success{};
         Color result;
     };
-    [[nodiscard]] ConversionResult commands_to_color(const std::string &commands) const;
-    [[nodiscard]] ConversionResult name_to_color(const std::string &name) const;
+    [[nodiscard]] ConversionResult commands_to_color(std::string_view commands) const;
+    [[nodiscard]] ConversionResult name_to_color(std::string_view name) const;
     [[nodiscard]] bool is_light() const;
 
+    static const std::vector<std::string> &get_slot_names();
+
+    // minimum contrast of FOREGROUND, COLOR7 and COLOR15 against BACKGROUND in every transition frame (WCAG AA)
+    static constexpr float text_contrast = 4.5f;
+
 private:
     Color find_background_color(bool find_light);
     Color find_text_color(bool find_light);
     Color find_contrasting_color(bool find_light);
 
     void generate_special_colors();
+    void enforce_contrast();
 
-    std::vector<std::string> split_commands(const std::string &name) const;
+    Color *find_slot(const std::string &name);
 
-    const std::vector<std::string> Xresources_headers = {
-            "black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"
-    };
+    bool apply_command(Color &color, std::string_view command) const;
+
+    static const std::vector<std::string> Xresources_headers;
 
     bool light_theme;
 
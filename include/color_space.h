@@ -0,0 +1,19 @@
+#ifndef HUEMASTER_COLOR_SPACE_H
+#define HUEMASTER_COLOR_SPACE_H
+
+#include "vec3.h"
+
+// Float color conversions following the cv::cvtColor conventions:
+// RGB channels in [0, 1], HLS as (H in degrees, L, S in [0, 1]), Lab with L in [0, 100] (sRGB, D65).
+class ColorSpace {
+public:
+    static Vec3f rgb_to_hls(const Vec3f &rgb);
+    static Vec3f hls_to_rgb(const Vec3f &hls);
+    static Vec3f rgb_to_lab(const Vec3f &rgb);
+    static Vec3f lab_to_rgb(const Vec3f &lab);
+
+    static float linearize_channel(float channel);
+    static float lab_lightness(float relative_luminance);
+};
+
+#endif //HUEMASTER_COLOR_SPACE_H
@@ -1,23 +1,66 @@
 #ifndef HUEMASTER_CONFIGURATOR_H
 #define HUEMASTER_CONFIGURATOR_H
 
+#include <chrono>
 #include <string>
+#include <unordered_map>
 #include <toml.hpp>
 #include "color_scheme.h"
+#include "hook_runner.h"
+#include "parser.h"
+#include "writer.h"
 
 class Configurator {
 public:
     void load_config(const std::string &config_path);
-    void configure(const ColorScheme &color_scheme);
+    void prefetch();
+    void configure(const ColorScheme &color_scheme, const std::string &suffix = "");
+    std::vector<HookRunner::Outcome> reload();
 
-    std::string get_wallpaper_path();
+    [[nodiscard]] std::string get_wallpaper_path() const;
+
+    [[nodiscard]] bool has_variants() const;
+    [[nodiscard]] const std::string &get_light_suffix() const;
+    [[nodiscard]] const std::string &get_dark_suffix() const;
 private:
-    std::vector<std::string> format_paths;
-    std::vector<std::string> real_paths;
+    struct Section {
+        std::string name;
+        std::string reload_command;
+        bool reload_pending{};
+    };
+
+    // every section that writes the same real_path shares one destination
+    struct Destination {
+        std::string real_path;
+        std::vector<size_t> sections;
+    };
+
+    // sections are grouped by canonical format_path, so each template is read and rendered once per run
+    struct FormatGroup {
+        std::string format_path;
+        std::vector<Destination> destinations;
+    };
+
+    std::vector<Section> sections;
+    std::vector<FormatGroup> format_groups;
+    std::unordered_map<std::string, size_t> format_group_indices;
+    std::unordered_map<std::string, size_t> destination_groups;
     std::string wallpaper_path;
 
+    int max_parallel_hooks = 4;
+    std::chrono::milliseconds hook_timeout{5000};
+
+    bool variants = false;
+    std::string light_suffix = ".light";
+    std::string dark_suffix = ".dark";
+
+    std::vector<FormatTemplate> templates;
+    std::unordered_map<std::string, Writer::FileState> file_states;
+
     void load_format(const std::string &section_name, const toml::value &section_data);
     void load_wallpaper_path(const std::string &section_name, const toml::value &section_data);
+    void load_variants(const std::string &section_name, const toml::value &section_data);
+    void load_hooks(const std::string &section_name, const toml::value &section_data);
 };
 
 #endif //HUEMASTER_CONFIGURATOR_H
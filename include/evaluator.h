@@ -0,0 +1,55 @@
+#ifndef HUEMASTER_EVALUATOR_H
+#define HUEMASTER_EVALUATOR_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "color_scheme.h"
+
+class Evaluator {
+public:
+    struct Thresholds {
+        float max_delta_e = -1.0f; // negative: derived from the reseed noise floor
+        float noise_margin = 1.5f;
+        float min_delta_e = 2.3f;  // about one just-noticeable difference in CIE76
+        float min_contrast = 3.0f;
+    };
+
+    typedef std::function<ColorScheme(const Image &)> Generator;
+
+    explicit Evaluator(const Thresholds &thresholds);
+
+    // A non-gating candidate is reported but cannot fail the run; that is for anything whose output depends on wall
+    // time, such as a time-budgeted extraction, and would make the result depend on machine load.
+    void add_candidate(const std::string &name, const Generator &generator, bool gating = true);
+
+    bool run(std::ostream &out);
+
+    static ColorScheme generate_reference(const Image &image);
+    static ColorScheme generate_reference(const Image &image, uint64_t seed);
+
+private:
+    struct Candidate {
+        std::string name;
+        Generator generator;
+        bool gating;
+    };
+
+    struct SlotStats {
+        float max_delta_e = 0.0f;
+        float total_delta_e = 0.0f;
+    };
+
+    static std::vector<Image> generate_corpus();
+    static float worst_slot_delta_e(const std::vector<ColorScheme> &from, const std::vector<ColorScheme> &to);
+    bool evaluate_candidate(const Candidate &candidate, const std::vector<Image> &corpus,
+                            const std::vector<ColorScheme> &reference_schemes, double reference_seconds,
+                            float max_delta_e, std::ostream &out) const;
+
+    Thresholds thresholds;
+    std::vector<Candidate> candidates;
+};
+
+#endif //HUEMASTER_EVALUATOR_H
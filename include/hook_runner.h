@@ -0,0 +1,33 @@
+#ifndef HUEMASTER_HOOK_RUNNER_H
+#define HUEMASTER_HOOK_RUNNER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Runs shell commands (`/bin/sh -c`) in parallel, at most max_parallel at a time, and kills any command (with its
+// process group) that outlives the timeout. run() returns once the last command has finished.
+class HookRunner {
+public:
+    struct Hook {
+        std::string name;
+        std::string command;
+    };
+
+    struct Outcome {
+        std::string name;
+        int exit_status{};  // exit code, or 128 + signal number if the command was killed
+        bool timed_out{};
+        double milliseconds{};
+    };
+
+    HookRunner(int max_parallel, std::chrono::milliseconds timeout);
+
+    [[nodiscard]] std::vector<Outcome> run(const std::vector<Hook> &hooks) const;
+
+private:
+    int max_parallel;
+    std::chrono::milliseconds timeout;
+};
+
+#endif //HUEMASTER_HOOK_RUNNER_H
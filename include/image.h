@@ -3,23 +3,45 @@
 
 #include <vector>
 #include <string>
-#include <opencv2/opencv.hpp>
 #include <filesystem>
+#ifndef HUEMASTER_LITE_IMAGE
+#include <opencv2/opencv.hpp>
+#endif
 
 #include "color.h"
+#include "kmeans.h"
 
 class Image {
 public:
     explicit Image(const std::string &path);
+#ifndef HUEMASTER_LITE_IMAGE
+    explicit Image(cv::Mat rgb_image);
+#endif
+
+    struct Extraction {
+        std::vector<Color> colors;
+        KMeans::Termination termination;
+        int iterations;
+    };
 
     [[nodiscard]] std::vector<Color> get_dominant_colors() const;
+    [[nodiscard]] std::vector<Color> get_dominant_colors(const KMeans &kmeans) const;
+    [[nodiscard]] Extraction extract_dominant_colors(const KMeans &kmeans) const;
     [[nodiscard]] float calculate_mean_luminance() const;
 
     void resize(int width, int height);
 
     [[nodiscard]] bool is_light() const;
 private:
+    [[nodiscard]] std::vector<float> get_samples() const;
+
+#ifdef HUEMASTER_LITE_IMAGE
+    int width{};
+    int height{};
+    std::vector<unsigned char> pixels; // packed RGB, row-major
+#else
     cv::Mat image;
+#endif
 };
 
 #endif //HUEMASTER_IMAGE_H
@@ -0,0 +1,25 @@
+#ifndef HUEMASTER_IMAGE_DECODER_H
+#define HUEMASTER_IMAGE_DECODER_H
+
+#include <string>
+#include <vector>
+
+// Decodes JPEG, PNG and (when available) WebP files straight through the codec libraries.
+// Only used by the lightweight build, where OpenCV is not linked.
+class ImageDecoder {
+public:
+    struct DecodedImage {
+        int width{};
+        int height{};
+        std::vector<unsigned char> pixels; // packed RGB, row-major
+    };
+
+    static DecodedImage decode(const std::string &path);
+
+private:
+    static DecodedImage decode_jpeg(const std::vector<unsigned char> &data, const std::string &path);
+    static DecodedImage decode_png(const std::vector<unsigned char> &data, const std::string &path);
+    static DecodedImage decode_webp(const std::vector<unsigned char> &data, const std::string &path);
+};
+
+#endif //HUEMASTER_IMAGE_DECODER_H
@@ -0,0 +1,70 @@
+#ifndef HUEMASTER_KMEANS_H
+#define HUEMASTER_KMEANS_H
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "vec3.h"
+
+class WorkerPool;
+
+// In-tree k-means (k-means++ seeding, Lloyd iterations) over packed 3-channel float samples.
+//
+// With a time budget the clustering is an anytime algorithm: all attempts first run on a strided subsample, which gives
+// a complete palette within a small fraction of the full cost, and Lloyd iterations over every sample then refine the
+// best one. Each further attempt or iteration only starts if it is expected to finish before the deadline.
+//
+// With more than one thread, assignment and center updates are split over fixed sample blocks, and without a time
+// budget the attempts also run side by side. Seeds and the order partial sums are combined in are independent of the
+// thread count, so an unbudgeted result is too. A budgeted result depends on how much work fits before the deadline,
+// which more threads (or a less loaded machine) change.
+class KMeans {
+public:
+    enum class Termination {
+        converged,       // every attempt moved its centers by less than epsilon
+        iteration_limit, // some attempt ran max_iterations without converging
+        deadline         // the time budget cut refinement short
+    };
+
+    struct Result {
+        std::vector<Vec3f> centers;
+        std::vector<int> counts;
+        double compactness{};
+        int iterations{};
+        Termination termination = Termination::converged;
+    };
+
+    KMeans(int num_clusters, int max_iterations, float epsilon, int attempts, uint64_t seed = 0x5eed);
+
+    void set_time_budget(std::chrono::microseconds budget);
+    void set_threads(int threads); // 0 uses every hardware thread
+
+    [[nodiscard]] Result cluster(const std::vector<float> &samples) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Result run_attempts(const std::vector<float> &samples, Clock::time_point deadline) const;
+    Result run_attempt(const std::vector<float> &samples, std::mt19937_64 &rng, Clock::time_point deadline,
+                       WorkerPool &pool) const;
+    void refine(const std::vector<float> &samples, Clock::time_point deadline, Clock::duration iteration_cost,
+                Result &result, WorkerPool &pool) const;
+
+    static std::vector<float> initial_centers(const std::vector<float> &samples, int num_clusters,
+                                              std::mt19937_64 &rng, WorkerPool &pool);
+    static double assign(const std::vector<float> &samples, const std::vector<float> &centers,
+                         std::vector<int> &labels, WorkerPool &pool);
+    static float update_centers(const std::vector<float> &samples, std::vector<int> &labels,
+                                std::vector<float> &centers, WorkerPool &pool);
+
+    int num_clusters;
+    int max_iterations;
+    float epsilon;
+    int attempts;
+    uint64_t seed;
+    std::chrono::microseconds time_budget = std::chrono::microseconds::max();
+    int threads = 1;
+};
+
+#endif //HUEMASTER_KMEANS_H
@@ -0,0 +1,31 @@
+#ifndef HUEMASTER_PALETTE_CLIENT_H
+#define HUEMASTER_PALETTE_CLIENT_H
+
+#include <string>
+#include <vector>
+
+// Talks to a PaletteServer; all requests of a query are sent before the first response is read.
+class PaletteClient {
+public:
+    struct Response {
+        bool success{};
+        std::string payload;
+    };
+
+    explicit PaletteClient(const std::string &socket_path);
+    ~PaletteClient();
+
+    PaletteClient(const PaletteClient &) = delete;
+    PaletteClient &operator=(const PaletteClient &) = delete;
+
+    std::vector<Response> query(const std::vector<std::string> &requests);
+
+private:
+    Response read_response();
+    void fill_buffer();
+
+    int fd = -1;
+    std::string buffer;
+};
+
+#endif //HUEMASTER_PALETTE_CLIENT_H
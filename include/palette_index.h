@@ -0,0 +1,92 @@
+#ifndef HUEMASTER_PALETTE_INDEX_H
+#define HUEMASTER_PALETTE_INDEX_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "vec3.h"
+
+// Memory-mapped index of the palettes of a wallpaper library.
+//
+// File layout (native endianness), version 1:
+//   Header                       magic "HMPALIDX", version, entry count, entry size, string table offset
+//   Entry[entry_count]           fixed-size records, see below
+//   char[]                       string table holding the image paths
+// Each entry keeps the image's modification time and size (for incremental updates), its dominant colors as
+// Lab + proportion, and the Lab value of every ColorScheme slot in ColorScheme::get_slot_names() order.
+class PaletteIndex {
+public:
+    static constexpr uint32_t version = 1;
+    static constexpr int palette_size = 32;
+    static constexpr int slot_count = 23;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_count;
+        uint32_t entry_size;
+        uint32_t reserved;
+        uint64_t strings_offset;
+    };
+
+    struct Entry {
+        uint64_t path_offset;
+        uint32_t path_length;
+        uint32_t palette_count;
+        int64_t modified;
+        uint64_t file_size;
+        uint32_t light;
+        uint32_t reserved;
+        float palette[palette_size][4]; // L, a, b, proportion
+        float slots[slot_count][3];     // L, a, b
+    };
+
+    struct PaletteColor {
+        Vec3f lab;
+        float weight;
+    };
+
+    struct Query {
+        std::vector<PaletteColor> palette;
+        int background = -1; // -1 any, 0 dark, 1 light
+        int accent = -1;     // -1 any, 0 cool, 1 warm
+    };
+
+    struct Match {
+        std::string path;
+        float distance;
+    };
+
+    explicit PaletteIndex(std::string index_path);
+    ~PaletteIndex();
+
+    PaletteIndex(const PaletteIndex &) = delete;
+    PaletteIndex &operator=(const PaletteIndex &) = delete;
+
+    void update(const std::string &directory, std::ostream &log);
+    [[nodiscard]] std::vector<Match> find(const Query &query, size_t count) const;
+
+    bool lookup(const std::string &image_path, std::vector<PaletteColor> &palette) const;
+    static std::vector<PaletteColor> image_palette(const std::string &image_path);
+    static std::vector<PaletteColor> parse_palette(const std::string &hex_colors);
+
+    static std::string default_index_path();
+
+private:
+    void map();
+    void unmap();
+
+    [[nodiscard]] std::string entry_path(const Entry &entry) const;
+    static Entry build_entry(const std::string &image_path);
+    static bool matches_filters(const Entry &entry, const Query &query);
+    static float palette_distance(const std::vector<PaletteColor> &query, const Entry &entry);
+
+    std::string index_path;
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    const Header *header = nullptr;
+    const Entry *entries = nullptr;
+};
+
+#endif //HUEMASTER_PALETTE_INDEX_H
@@ -0,0 +1,84 @@
+#ifndef HUEMASTER_PALETTE_SERVER_H
+#define HUEMASTER_PALETTE_SERVER_H
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "color_scheme.h"
+#include "parser.h"
+
+// Keeps a ColorScheme resident and answers queries over a local Unix domain socket.
+//
+// Requests are single lines, and any number of them may be sent without waiting for the answers:
+//   EVAL <placeholder>    value of a placeholder expression, e.g. `EVAL ACCENT.alpha(60).HEXRGBA`
+//   DUMP                  `THEME light|dark` followed by one `<SLOT> #RRGGBB` line per slot
+//   RENDER <format_path>  the rendered format file
+//   WALLPAPER <path>      switch wallpaper, regenerate the scheme and rewrite the configured files
+// Every request gets exactly one response, in order: `OK <length>\n<payload>` or `ERR <length>\n<message>`.
+//
+// A wallpaper switch runs on a worker thread while every other connection keeps being answered from the current
+// scheme, which is replaced once the switch finishes. Only the requesting connection waits for its response;
+// further switches queue behind the running one.
+class PaletteServer {
+public:
+    typedef std::function<ColorScheme(const std::string &)> WallpaperHandler;
+
+    PaletteServer(std::string socket_path, ColorScheme color_scheme, WallpaperHandler wallpaper_handler);
+    ~PaletteServer();
+
+    void run();
+
+    static std::string default_socket_path();
+
+private:
+    struct Connection {
+        uint64_t id{};
+        std::string input;
+        std::string output;
+        bool closing{};
+        bool awaiting_wallpaper{};
+    };
+
+    struct WallpaperRequest {
+        uint64_t connection_id;
+        std::string path;
+    };
+
+    struct CachedTemplate {
+        std::filesystem::file_time_type modified;
+        FormatTemplate format_template;
+    };
+
+    void open_socket();
+    void accept_connections();
+    bool read_requests(int fd, Connection &connection);
+    bool write_responses(int fd, Connection &connection);
+    void process_input(Connection &connection);
+
+    void handle_request(const std::string &request, Connection &connection);
+    void handle_eval(const std::string &argument, std::string &payload) const;
+    void handle_dump(std::string &payload) const;
+    void handle_render(const std::string &argument, std::string &payload);
+    void queue_wallpaper(const std::string &argument, Connection &connection);
+    void start_wallpaper();
+    void finish_wallpaper();
+
+    std::string socket_path;
+    int listen_fd = -1;
+    ColorScheme color_scheme;
+    WallpaperHandler wallpaper_handler;
+    std::unordered_map<int, Connection> connections;
+    uint64_t next_connection_id = 0;
+    std::unordered_map<std::string, CachedTemplate> templates;
+
+    std::deque<WallpaperRequest> wallpaper_requests; // the front one is running while wallpaper_job is valid
+    std::future<ColorScheme> wallpaper_job;
+    int wallpaper_pipe[2] = {-1, -1};                // the worker writes a byte here when it is done
+};
+
+#endif //HUEMASTER_PALETTE_SERVER_H
@@ -3,17 +3,34 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
 #include "color_scheme.h"
 
+// A format file split into literal text and placeholders, so it can be rendered without re-reading it.
+struct FormatTemplate {
+    struct Segment {
+        std::string text;
+        bool placeholder{};
+        int line_number{};
+    };
+
+    std::string format_path;
+    std::vector<Segment> segments;
+    size_t literal_size{};
+};
+
 class Parser {
 public:
     static std::string parse(const std::string &format_path, const ColorScheme &color_scheme);
-    static std::string parse_line(const std::string &format_path, const ColorScheme &color_scheme,
-                                  const std::string &line, int line_number);
-    static std::string parse_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
-                                         const std::string &placeholder, int line_number);
-    static std::string parse_ternary_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
-                                                 const std::string &placeholder, int line_number);
+
+    static FormatTemplate scan(const std::string &format_path);
+    static void scan_line(const std::string &line, int line_number, FormatTemplate &format_template);
+    static void render(const FormatTemplate &format_template, const ColorScheme &color_scheme, std::string &output);
+
+    static void parse_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
+                                  const std::string &placeholder, int line_number, std::string &output);
+    static void parse_ternary_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
+                                          const std::string &placeholder, int line_number, std::string &output);
 };
 
 #endif //HUEMASTER_PARSER_H
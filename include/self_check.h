@@ -0,0 +1,26 @@
+#ifndef HUEMASTER_SELF_CHECK_H
+#define HUEMASTER_SELF_CHECK_H
+
+#include <ostream>
+#include <vector>
+#include "color_scheme.h"
+
+// Checks that need neither OpenCV nor an image corpus, so every build configuration runs them (`huemaster
+// --self-check`, also registered with CTest).
+class SelfCheck {
+public:
+    static bool run(std::ostream &out);
+
+private:
+    struct Palette {
+        const char *name;
+        std::vector<Color> colors;
+        bool light;
+    };
+
+    static std::vector<Palette> generate_palettes();
+    static bool check_transition_contrast(const std::vector<Palette> &palettes, std::ostream &out);
+    static bool check_allocations(const std::vector<Palette> &palettes, std::ostream &out);
+};
+
+#endif //HUEMASTER_SELF_CHECK_H
@@ -0,0 +1,45 @@
+#ifndef HUEMASTER_VEC3_H
+#define HUEMASTER_VEC3_H
+
+#ifdef HUEMASTER_LITE_IMAGE
+
+// Minimal stand-in for cv::Vec3f when building without OpenCV.
+struct Vec3f {
+    float val[3]{};
+
+    Vec3f() = default;
+    Vec3f(float v0, float v1, float v2) : val{v0, v1, v2} { }
+
+    float &operator[](int i) { return val[i]; }
+    const float &operator[](int i) const { return val[i]; }
+};
+
+inline Vec3f operator+(const Vec3f &a, const Vec3f &b) {
+    return {a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+}
+
+inline Vec3f operator-(const Vec3f &a, const Vec3f &b) {
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+inline Vec3f operator*(const Vec3f &v, float s) {
+    return {v[0] * s, v[1] * s, v[2] * s};
+}
+
+inline Vec3f operator*(float s, const Vec3f &v) {
+    return v * s;
+}
+
+inline Vec3f operator/(const Vec3f &v, float s) {
+    return {v[0] / s, v[1] / s, v[2] / s};
+}
+
+#else
+
+#include <opencv2/opencv.hpp>
+
+typedef cv::Vec3f Vec3f;
+
+#endif
+
+#endif //HUEMASTER_VEC3_H
@@ -0,0 +1,47 @@
+#ifndef HUEMASTER_WORKER_POOL_H
+#define HUEMASTER_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run indexed jobs, so a computation made of many short parallel steps pays for thread
+// creation once. The calling thread takes part in every run; a pool of one thread starts none.
+class WorkerPool {
+public:
+    typedef std::function<void(int)> Job;
+
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Calls job(index) for every index in [0, count) and returns once all of them have finished. If a job throws, the
+    // indices not yet started are skipped and the first exception is rethrown once the running jobs have finished.
+    void run(int count, const Job &job);
+
+private:
+    void work();
+    void drain();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Job *job = nullptr;
+    int count = 0;
+    std::atomic<int> next{0};
+    int active = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+};
+
+#endif //HUEMASTER_WORKER_POOL_H
@@ -1,12 +1,28 @@
 #ifndef HUEMASTER_WRITER_H
 #define HUEMASTER_WRITER_H
 
+#include <cstdint>
+#include <filesystem>
 #include <string>
 #include <fstream>
 
 class Writer {
 public:
-    static void write(const std::string &real_path, const std::string &parsed_config);
+    struct FileState {
+        bool exists{};
+        std::uintmax_t size{};
+        std::filesystem::file_time_type modified{};
+        // content_hash is the hash of the file's contents, learned when this process last wrote or compared it
+        bool hash_known{};
+        std::uint64_t content_hash{};
+    };
+
+    static FileState stat(const std::string &real_path);
+    static std::uint64_t hash(const std::string &content);
+
+    static bool write(const std::string &real_path, const std::string &parsed_config);
+    static bool write(const std::string &real_path, const std::string &parsed_config, std::uint64_t content_hash,
+                      FileState &state);
 };
 
 #endif //HUEMASTER_WRITER_H
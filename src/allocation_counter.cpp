@@ -0,0 +1,69 @@
+#include "allocation_counter.h"
+
+#include <cerrno>
+#include <cstddef>
+
+#ifndef __GLIBC__
+#error "the allocation counter interposes glibc's malloc; configure with -DHUEMASTER_COUNT_ALLOCATIONS=OFF"
+#endif
+
+// glibc's own entry points, which the replacements below forward to; free() is left alone since it accepts what
+// these return.
+extern "C" {
+    void *__libc_malloc(std::size_t size);
+    void *__libc_calloc(std::size_t count, std::size_t size);
+    void *__libc_realloc(void *memory, std::size_t size);
+    void *__libc_memalign(std::size_t alignment, std::size_t size);
+}
+
+namespace {
+    // zero-initialized in the executable's static TLS block, so reading it never allocates
+    thread_local std::uint64_t allocations = 0;
+}
+
+std::uint64_t AllocationCounter::thread_allocations() {
+    return allocations;
+}
+
+extern "C" {
+    void *malloc(std::size_t size) noexcept {
+        allocations++;
+        return __libc_malloc(size);
+    }
+
+    void *calloc(std::size_t count, std::size_t size) noexcept {
+        allocations++;
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *memory, std::size_t size) noexcept {
+        if (size != 0) { // realloc(memory, 0) frees
+            allocations++;
+        }
+        return __libc_realloc(memory, size);
+    }
+
+    void *memalign(std::size_t alignment, std::size_t size) noexcept {
+        allocations++;
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+        allocations++;
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void **memory, std::size_t alignment, std::size_t size) noexcept {
+        if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+            return EINVAL;
+        }
+
+        allocations++;
+        void *allocated = __libc_memalign(alignment, size);
+        if (allocated == nullptr) {
+            return ENOMEM;
+        }
+        *memory = allocated;
+        return 0;
+    }
+}
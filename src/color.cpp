@@ -1,5 +1,35 @@
 #include "color.h"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+#include "color_space.h"
+
+#ifndef HUEMASTER_LITE_IMAGE
+namespace {
+    // Converts one pixel through cv::cvtColor with both Mats wrapping the caller's stack memory; since the output
+    // already has the right size and type, cvtColor writes into it instead of allocating.
+    void cvt_pixel(const Vec3f &input, Vec3f &output, int code) {
+        cv::Mat input_mat(1, 1, CV_32FC3, const_cast<float *>(input.val));
+        cv::Mat output_mat(1, 1, CV_32FC3, output.val);
+        cv::cvtColor(input_mat, output_mat, code);
+    }
+
+    bool in_tree_color_space = false;
+}
+
+Color::InTreeColorSpaceScope::InTreeColorSpaceScope() : previous(in_tree_color_space) {
+    in_tree_color_space = true;
+}
+
+Color::InTreeColorSpaceScope::~InTreeColorSpaceScope() {
+    in_tree_color_space = previous;
+}
+#endif
+
 const std::string Color::format_names[] = {
     "HEXRGB",
     "HEXRGBA",
@@ -12,12 +42,36 @@ const std::string Color::format_names[] = {
     "CARGB"
 };
 
-Color::Color(const cv::Vec3f &color) : color(color) { }
+namespace {
+    // two lowercase hex digits for every byte value
+    constexpr std::array<char, 512> hex_table = [] {
+        const char digits[] = "0123456789abcdef";
+        std::array<char, 512> table{};
+        for (int byte = 0; byte < 256; byte++) {
+            table[2 * byte] = digits[byte >> 4];
+            table[2 * byte + 1] = digits[byte & 0xf];
+        }
+        return table;
+    }();
+
+    void append_hex_byte(std::string &output, int value) {
+        value = std::clamp(value, 0, 255);
+        output.append(&hex_table[2 * value], 2);
+    }
+
+    void append_int(std::string &output, int value) {
+        char buffer[12];
+        std::to_chars_result result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+        output.append(buffer, result.ptr);
+    }
+}
+
+Color::Color(const Vec3f &color) : color(color) { }
 
-Color::Color(const cv::Vec3f &color, float proportion) : color(color), proportion(proportion) { }
+Color::Color(const Vec3f &color, float proportion) : color(color), proportion(proportion) { }
 
 float Color::calculate_luminance() const {
-    cv::Vec3f normalized_color = normalize_color(color);
+    Vec3f normalized_color = normalize_color(color);
     return 0.2126f * normalized_color[2] + 0.7152f * normalized_color[1] + 0.0722f * normalized_color[0];
 }
 
@@ -36,10 +90,9 @@ float Color::calculate_contrast(const Color &other) const {
 }
 
 float Color::calculate_distance(const Color &other) const {
-    cv::Mat lab_color1, lab_color2;
-    cv::cvtColor(cv::Mat(1, 1, CV_32FC3, color / 255.0f), lab_color1, cv::COLOR_RGB2Lab);
-    cv::cvtColor(cv::Mat(1, 1, CV_32FC3, other.get_color() / 255.0f), lab_color2, cv::COLOR_RGB2Lab);
-    return (float) cv::norm(lab_color1, lab_color2);
+    Vec3f lab_difference = to_lab(color) - to_lab(other.get_color());
+    return std::sqrt(lab_difference[0] * lab_difference[0] + lab_difference[1] * lab_difference[1]
+                     + lab_difference[2] * lab_difference[2]);
 }
 
 float Color::calculate_minimum_distance(const std::vector<Color> &colors) const {
@@ -56,41 +109,36 @@ float Color::calculate_minimum_distance(const std::vector<Color> &colors) const
 void Color::adjust_minmax_luminance(float target_luminance, bool is_light) {
     target_luminance /= 100.0f;
 
-    cv::Mat hls_color;
-    cv::cvtColor(cv::Mat(1, 1, CV_32FC3, color / 255.0f), hls_color, cv::COLOR_RGB2HLS);
+    Vec3f hls_color = to_hls(color);
 
-    float current_luminance = hls_color.at<cv::Vec3f>(0, 0)[1];
+    float current_luminance = hls_color[1];
     if ((is_light && current_luminance < target_luminance)
         || (!is_light && current_luminance > target_luminance)) {
-        hls_color.at<cv::Vec3f>(0, 0)[1] = target_luminance;
+        hls_color[1] = target_luminance;
     }
 
-    cv::cvtColor(hls_color, hls_color, cv::COLOR_HLS2RGB);
-    color = hls_color.at<cv::Vec3f>(0, 0) * 255.0f;
+    color = from_hls(hls_color);
 }
 
 void Color::adjust_min_contrast(float target_contrast, const Color &background_color, bool is_light) {
     float current_contrast = calculate_contrast(background_color);
-    cv::Vec3f adjusted_color = color;
+    Vec3f adjusted_color = color;
 
     while (current_contrast < target_contrast) {
-        cv::Mat hls_color;
-        cv::cvtColor(cv::Mat(1, 1, CV_32FC3, adjusted_color / 255.0f), hls_color, cv::COLOR_RGB2HLS);
+        Vec3f hls_color = to_hls(adjusted_color);
 
         float luminance_multiplier = is_light ? 1.1f : 0.9f;
-        hls_color.at<cv::Vec3f>(0, 0)[1] *= luminance_multiplier;
+        hls_color[1] *= luminance_multiplier;
 
-        if (hls_color.at<cv::Vec3f>(0, 0)[1] > 1.0f) {
-            hls_color.at<cv::Vec3f>(0, 0)[1] = 1.0f;
+        if (hls_color[1] > 1.0f) {
             break;
         }
 
-        if (std::abs(hls_color.at<cv::Vec3f>(0, 0)[1]) < 1e-6) {
+        if (std::abs(hls_color[1]) < 1e-6) {
             break;
         }
 
-        cv::cvtColor(hls_color, hls_color, cv::COLOR_HLS2RGB);
-        adjusted_color = hls_color.at<cv::Vec3f>(0, 0) * 255.0f;
+        adjusted_color = from_hls(hls_color);
 
         color = adjusted_color;
         current_contrast = calculate_contrast(background_color);
@@ -105,18 +153,16 @@ void Color::adjust_contrast_color(const Color &background_color, bool is_light)
 void Color::adjust_luminance(float amount) {
     amount /= 100.0f;
 
-    cv::Mat hls_color;
-    cv::cvtColor(cv::Mat(1, 1, CV_32FC3, color / 255.0f), hls_color, cv::COLOR_RGB2HLS);
+    Vec3f hls_color = to_hls(color);
 
-    hls_color.at<cv::Vec3f>(0, 0)[1] += amount;
-    if (hls_color.at<cv::Vec3f>(0, 0)[1] > 1.0f) {
-        hls_color.at<cv::Vec3f>(0, 0)[1] = 1.0f;
-    } else if (hls_color.at<cv::Vec3f>(0, 0)[1] < 0.0f) {
-        hls_color.at<cv::Vec3f>(0, 0)[1] = 0.0f;
+    hls_color[1] += amount;
+    if (hls_color[1] > 1.0f) {
+        hls_color[1] = 1.0f;
+    } else if (hls_color[1] < 0.0f) {
+        hls_color[1] = 0.0f;
     }
 
-    cv::cvtColor(hls_color, hls_color, cv::COLOR_HLS2RGB);
-    color = hls_color.at<cv::Vec3f>(0, 0) * 255.0f;
+    color = from_hls(hls_color);
 }
 
 void Color::adjust_alpha(float amount) {
@@ -129,42 +175,55 @@ void Color::adjust_alpha(float amount) {
 }
 
 void Color::adjust_hue(float target_hue) {
-    cv::Mat hls_color;
-    cv::cvtColor(cv::Mat(1, 1, CV_32FC3, color / 255.0f), hls_color, cv::COLOR_RGB2HLS);
+    Vec3f hls_color = to_hls(color);
 
-    hls_color.at<cv::Vec3f>(0, 0)[0] = target_hue;
-    if (hls_color.at<cv::Vec3f>(0, 0)[2] < 0.1f) {
-        hls_color.at<cv::Vec3f>(0, 0)[2] = 1.0f;
+    hls_color[0] = target_hue;
+    if (hls_color[2] < 0.1f) {
+        hls_color[2] = 1.0f;
     }
 
-    cv::cvtColor(hls_color, hls_color, cv::COLOR_HLS2RGB);
-    color = hls_color.at<cv::Vec3f>(0, 0) * 255.0f;
+    color = from_hls(hls_color);
 }
 
-bool Color::is_valid_format(const std::string &format) {
+bool Color::is_valid_format(std::string_view format) {
     auto result = std::find(std::begin(format_names), std::end(format_names), format);
     return result != std::end(format_names);
 }
 
-void Color::set_format(const std::string &format) {
+bool Color::set_format(std::string_view format) {
     auto it = std::find(std::begin(format_names), std::end(format_names), format);
+    if (it == std::end(format_names)) {
+        return false;
+    }
+
     int idx = std::distance(std::begin(format_names), it);
     this->format = (StringFormat) idx;
+    return true;
 }
 
-cv::Vec3f Color::get_color() const {
+Vec3f Color::get_color() const {
     return color;
 }
 
+Vec3f Color::get_lab() const {
+    return to_lab(color);
+}
+
 float Color::get_proportion() const {
     return proportion;
 }
 
 std::string Color::to_string() const {
+    std::string output;
+    append_to(output);
+    return output;
+}
+
+void Color::append_to(std::string &output) const {
     if (format == HEXRGB || format == HEXRGBA || format == HEXARGB) {
-        return to_hex();
+        append_hex(output);
     } else {
-        return to_rgb();
+        append_rgb(output);
     }
 }
 
@@ -175,8 +234,29 @@ Color Color::multiply(float amount) {
     return product;
 }
 
-cv::Vec3f Color::normalize_color(const cv::Vec3f &color) {
-    cv::Vec3f normalized_color = {
+Color Color::from_hex(const std::string &hex) {
+    std::string digits = !hex.empty() && hex[0] == '#' ? hex.substr(1) : hex;
+    if (digits.size() != 6 || digits.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+        throw std::runtime_error("Invalid color (expected #RRGGBB): `" + hex + "`");
+    }
+
+    unsigned long value = std::stoul(digits, nullptr, 16);
+    return Color(Vec3f((float) ((value >> 16) & 0xff), (float) ((value >> 8) & 0xff), (float) (value & 0xff)));
+}
+
+Color Color::interpolate(const Color &from, const Color &to, float amount) {
+    Vec3f from_lab_color = to_lab(from.color);
+    Vec3f to_lab_color = to_lab(to.color);
+
+    Color result = to;
+    result.color = from_lab(from_lab_color + (to_lab_color - from_lab_color) * amount);
+    result.alpha = from.alpha + (to.alpha - from.alpha) * amount;
+    result.proportion = from.proportion + (to.proportion - from.proportion) * amount;
+    return result;
+}
+
+Vec3f Color::normalize_color(const Vec3f &color) {
+    Vec3f normalized_color = {
             normalize_channel(color[0]),
             normalize_channel(color[1]),
             normalize_channel(color[2])
@@ -184,6 +264,51 @@ cv::Vec3f Color::normalize_color(const cv::Vec3f &color) {
     return normalized_color;
 }
 
+Vec3f Color::to_hls(const Vec3f &color) {
+#ifndef HUEMASTER_LITE_IMAGE
+    if (!in_tree_color_space) {
+        Vec3f rgb_color = color / 255.0f, hls_color;
+        cvt_pixel(rgb_color, hls_color, cv::COLOR_RGB2HLS);
+        return hls_color;
+    }
+#endif
+    return ColorSpace::rgb_to_hls(color / 255.0f);
+}
+
+Vec3f Color::from_hls(const Vec3f &hls_color) {
+#ifndef HUEMASTER_LITE_IMAGE
+    if (!in_tree_color_space) {
+        Vec3f rgb_color;
+        cvt_pixel(hls_color, rgb_color, cv::COLOR_HLS2RGB);
+        return rgb_color * 255.0f;
+    }
+#endif
+    return ColorSpace::hls_to_rgb(hls_color) * 255.0f;
+}
+
+Vec3f Color::to_lab(const Vec3f &color) {
+#ifndef HUEMASTER_LITE_IMAGE
+    if (!in_tree_color_space) {
+        Vec3f rgb_color = color / 255.0f, lab_color;
+        cvt_pixel(rgb_color, lab_color, cv::COLOR_RGB2Lab);
+        return lab_color;
+    }
+#endif
+    return ColorSpace::rgb_to_lab(color / 255.0f);
+}
+
+Vec3f Color::from_lab(const Vec3f &lab_color) {
+#ifndef HUEMASTER_LITE_IMAGE
+    if (!in_tree_color_space) {
+        Vec3f rgb;
+        cvt_pixel(lab_color, rgb, cv::COLOR_Lab2RGB);
+        return Vec3f(std::clamp(rgb[0], 0.0f, 1.0f), std::clamp(rgb[1], 0.0f, 1.0f),
+                     std::clamp(rgb[2], 0.0f, 1.0f)) * 255.0f;
+    }
+#endif
+    return ColorSpace::lab_to_rgb(lab_color) * 255.0f;
+}
+
 float Color::normalize_channel(float channel) {
     float srgb = channel / 255.0f;
     if (srgb <= 0.03928) {
@@ -193,45 +318,41 @@ float Color::normalize_channel(float channel) {
     }
 }
 
-std::string Color::to_hex() const {
-    std::stringstream stream;
-    stream << "#";
+void Color::append_hex(std::string &output) const {
+    output += '#';
 
     if (format == HEXARGB) {
-        stream << std::hex << std::setfill('0') << std::setw(2) << (int)(alpha * 255.0f);
+        append_hex_byte(output, (int) (alpha * 255.0f));
     }
 
-    stream << std::hex << std::setfill('0') << std::setw(2) << (int) color[0]
-           << std::hex << std::setfill('0') << std::setw(2) << (int) color[1]
-           << std::hex << std::setfill('0') << std::setw(2) << (int) color[2];
+    append_hex_byte(output, (int) color[0]);
+    append_hex_byte(output, (int) color[1]);
+    append_hex_byte(output, (int) color[2]);
 
     if (format == HEXRGBA) {
-        stream << std::hex << std::setfill('0') << std::setw(2) << (int)(alpha * 255.0f);
+        append_hex_byte(output, (int) (alpha * 255.0f));
     }
-
-    return stream.str();
 }
 
-std::string Color::to_rgb() const {
-    std::stringstream stream;
-
+void Color::append_rgb(std::string &output) const {
     char delim = ' ';
     if (format == CRGB || format == CRGBA || format == CARGB) {
         delim = ',';
     }
 
     if (format == ARGB || format == CARGB) {
-        stream << (int) (alpha * 255.0f) << delim;
+        append_int(output, (int) (alpha * 255.0f));
+        output += delim;
     }
 
-    stream << (int) color[0] << delim
-           << (int) color[1] << delim
-           << (int) color[2];
+    append_int(output, (int) color[0]);
+    output += delim;
+    append_int(output, (int) color[1]);
+    output += delim;
+    append_int(output, (int) color[2]);
 
     if (format == RGBA || format == CRGBA) {
-        stream << delim << (int) (alpha * 255.0f);
+        output += delim;
+        append_int(output, (int) (alpha * 255.0f));
     }
-
-    return stream.str();
 }
-
@@ -1,12 +1,32 @@
 #include "color_scheme.h"
 
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+const std::vector<std::string> ColorScheme::Xresources_headers = {
+        "black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"
+};
+
 ColorScheme::ColorScheme() {
     scheme_colors.assign(16, {});
 }
 
 void ColorScheme::generate(const Image &image) {
-    light_theme = image.is_light();
-    dominant_colors = image.get_dominant_colors();
+    generate(image.get_dominant_colors(), image.is_light());
+}
+
+void ColorScheme::generate(const std::vector<Color> &colors, bool light) {
+    // any palette works, including a partially refined one cut off by an extraction deadline
+    if (colors.empty()) {
+        throw std::runtime_error("Cannot generate a color scheme without dominant colors");
+    }
+
+    reset();
+    light_theme = light;
+    dominant_colors.assign(colors.begin(), colors.end());
 
     background_color = find_background_color(light_theme);
     used_colors.push_back(background_color);
@@ -44,74 +64,171 @@ void ColorScheme::generate(const Image &image) {
     scheme_colors[15] = color15;
 }
 
+// Back to the freshly constructed state, but the buffers keep their capacity, so a scheme that is reused for one
+// generation after another stops allocating once it has seen the largest palette.
+void ColorScheme::reset() {
+    light_theme = false;
+    text_color = background_color = Color();
+    error_color = good_color = warning_color = info_color = accent_color = Color();
+    std::fill(scheme_colors.begin(), scheme_colors.end(), Color());
+    dominant_colors.clear();
+    used_colors.clear();
+}
+
 void ColorScheme::print_Xresources() {
-    std::cout << "! special" << std::endl;
-    std::cout << "*.foreground:\t" << text_color.to_string() << std::endl;
-    std::cout << "*.background:\t" << background_color.to_string() << std::endl;
-    std::cout << "*.cursorColor:\t" << text_color.to_string() << std::endl;
+    std::string output;
+    output += "! special\n";
+    output += "*.foreground:\t";
+    text_color.append_to(output);
+    output += "\n*.background:\t";
+    background_color.append_to(output);
+    output += "\n*.cursorColor:\t";
+    text_color.append_to(output);
+    output += '\n';
 
     for (size_t i = 0; i < Xresources_headers.size(); i++) {
-        std::cout << std::endl;
-        std::cout << "! " << Xresources_headers[i] << std::endl;
-        std::cout << "*.color" << i << ":\t" << scheme_colors[i].to_string() << std::endl;
-        std::cout << "*.color" << i + 8 << ":\t" << scheme_colors[i + 8].to_string() << std::endl;
+        output += "\n! ";
+        output += Xresources_headers[i];
+        output += "\n*.color";
+        output += std::to_string(i);
+        output += ":\t";
+        scheme_colors[i].append_to(output);
+        output += "\n*.color";
+        output += std::to_string(i + 8);
+        output += ":\t";
+        scheme_colors[i + 8].append_to(output);
+        output += '\n';
     }
+
+    std::cout << output << std::flush;
 }
 
-ColorScheme::ConversionResult ColorScheme::commands_to_color(const std::string &commands) const {
-    std::vector<std::string> segments = split_commands(commands);
+void ColorScheme::append_dump(std::string &output) const {
+    output += light_theme ? "THEME light\n" : "THEME dark\n";
+    for (const std::string &slot_name: get_slot_names()) {
+        output += slot_name;
+        output += ' ';
+        name_to_color(slot_name).result.append_to(output);
+        output += '\n';
+    }
+}
 
-    if (segments.empty()) {
-        return {false, {}};
+ColorScheme ColorScheme::from_dump(const std::string &dump) {
+    ColorScheme color_scheme;
+    std::istringstream lines(dump);
+    std::string line;
+    size_t slots_read = 0;
+    bool theme_read = false;
+    while (std::getline(lines, line)) {
+        size_t separator = line.find(' ');
+        if (separator == std::string::npos) {
+            throw std::runtime_error("Invalid color scheme line: `" + line + "`");
+        }
+
+        std::string name = line.substr(0, separator);
+        std::string value = line.substr(separator + 1);
+        if (name == "THEME" && (value == "light" || value == "dark")) {
+            color_scheme.light_theme = value == "light";
+            theme_read = true;
+            continue;
+        }
+
+        Color *slot = color_scheme.find_slot(name);
+        if (slot == nullptr) {
+            throw std::runtime_error("Unknown color scheme slot: `" + name + "`");
+        }
+        *slot = Color::from_hex(value);
+        slots_read++;
     }
 
-    ConversionResult result = name_to_color(segments[0]);
+    if (!theme_read || slots_read != get_slot_names().size()) {
+        throw std::runtime_error("Incomplete color scheme");
+    }
+
+    return color_scheme;
+}
+
+ColorScheme ColorScheme::interpolate(const ColorScheme &from, const ColorScheme &to, float amount) {
+    ColorScheme color_scheme = to;
+    for (const std::string &slot_name: get_slot_names()) {
+        *color_scheme.find_slot(slot_name) = Color::interpolate(from.name_to_color(slot_name).result,
+                                                                to.name_to_color(slot_name).result, amount);
+    }
+
+    // Between a dark and a light scheme the side switches where the background's luminance reaches 0.1: below it
+    // white still reaches the dark theme's 7:1, above it black reaches the light theme's 3:1.
+    if (from.light_theme != to.light_theme) {
+        color_scheme.light_theme = color_scheme.background_color.calculate_luminance() > 0.1f;
+    }
+
+    // the endpoints meet their contrast targets, but a blend between them need not
+    color_scheme.enforce_contrast();
+    return color_scheme;
+}
+
+ColorScheme::ConversionResult ColorScheme::commands_to_color(std::string_view commands) const {
+    // segments are walked as views into `commands`, so evaluating a placeholder does not allocate
+    size_t segment_end = commands.find('.');
+    ConversionResult result = name_to_color(commands.substr(0, segment_end));
     if (!result.success) {
         return {false, {}};
     }
 
     Color color = result.result;
-    for (size_t i = 1; i < segments.size(); i++) {
-        size_t modifier_end = segments[i].find('(');
-        if (modifier_end == std::string::npos) {
-            if (!Color::is_valid_format(segments[i])) {
-                return {false, {}};
-            } else {
-                color.set_format(segments[i]);
-                continue;
-            }
-        }
-
-        std::string modifier = segments[i].substr(0, modifier_end);
-        if (segments[i].size() < modifier_end + 2 || segments[i].back() != ')') {
+    while (segment_end != std::string_view::npos) {
+        size_t segment_start = segment_end + 1;
+        segment_end = commands.find('.', segment_start);
+        std::string_view segment = commands.substr(segment_start, segment_end == std::string_view::npos
+                                                                  ? std::string_view::npos
+                                                                  : segment_end - segment_start);
+        if (!apply_command(color, segment)) {
             return {false, {}};
         }
+    }
 
-        std::string argument = segments[i].substr(modifier_end + 1, segments[i].size() - modifier_end - 2);
-        float amount;
-        try {
-            amount = std::stof(argument);
-        } catch (const std::invalid_argument &e) {
-            return {false, {}};
-        } catch (const std::out_of_range &e) {
-            return {false, {}};
-        }
+    return {true, color};
+}
 
-        if (modifier == "lighten") {
-            color.adjust_luminance(amount * (light_theme ? -1.0f : 1.0f));
-        } else if (modifier == "darken") {
-            color.adjust_luminance(-amount * (light_theme ? -1.0f : 1.0f));
-        } else if (modifier == "alpha") {
-            color.adjust_alpha(amount / 100.0f);
-        } else {
-            return {false, {}};
-        }
+bool ColorScheme::apply_command(Color &color, std::string_view command) const {
+    size_t modifier_end = command.find('(');
+    if (modifier_end == std::string_view::npos) {
+        return color.set_format(command);
     }
 
-    return {true, color};
+    std::string_view modifier = command.substr(0, modifier_end);
+    if (command.size() < modifier_end + 2 || command.back() != ')') {
+        return false;
+    }
+
+    // strtof needs a terminated string; an argument too long for the buffer is not a sensible amount anyway
+    std::string_view argument = command.substr(modifier_end + 1, command.size() - modifier_end - 2);
+    char buffer[32];
+    if (argument.size() >= sizeof(buffer)) {
+        return false;
+    }
+    argument.copy(buffer, argument.size());
+    buffer[argument.size()] = '\0';
+
+    char *end;
+    errno = 0;
+    float amount = std::strtof(buffer, &end);
+    if (end == buffer || errno == ERANGE) {
+        return false;
+    }
+
+    if (modifier == "lighten") {
+        color.adjust_luminance(amount * (light_theme ? -1.0f : 1.0f));
+    } else if (modifier == "darken") {
+        color.adjust_luminance(-amount * (light_theme ? -1.0f : 1.0f));
+    } else if (modifier == "alpha") {
+        color.adjust_alpha(amount / 100.0f);
+    } else {
+        return false;
+    }
+    return true;
 }
 
-ColorScheme::ConversionResult ColorScheme::name_to_color(const std::string &name) const {
+ColorScheme::ConversionResult ColorScheme::name_to_color(std::string_view name) const {
     if (name == "BACKGROUND") {
         return {true, background_color};
     } else if (name == "FOREGROUND") {
@@ -131,19 +248,13 @@ ColorScheme::ConversionResult ColorScheme::name_to_color(const std::string &name
             return {false, {}};
         }
 
-        std::string color_number = name.substr(5);
-        try {
-            int value = std::stoi(color_number);
-            if (value < 0 || value > 15) {
-                return {false, {}};
-            }
-
-            return {true, scheme_colors[value]};
-        } catch (const std::invalid_argument &e) {
-            return {false, {}};
-        } catch (const std::out_of_range &e) {
+        int value;
+        std::from_chars_result parsed = std::from_chars(name.data() + 5, name.data() + name.size(), value);
+        if (parsed.ec != std::errc() || value < 0 || value > 15) {
             return {false, {}};
         }
+
+        return {true, scheme_colors[value]};
     }
 }
 
@@ -151,6 +262,16 @@ bool ColorScheme::is_light() const {
     return light_theme;
 }
 
+const std::vector<std::string> &ColorScheme::get_slot_names() {
+    static const std::vector<std::string> slot_names = {
+            "BACKGROUND", "FOREGROUND",
+            "COLOR0", "COLOR1", "COLOR2", "COLOR3", "COLOR4", "COLOR5", "COLOR6", "COLOR7",
+            "COLOR8", "COLOR9", "COLOR10", "COLOR11", "COLOR12", "COLOR13", "COLOR14", "COLOR15",
+            "ACCENT", "GOOD", "WARNING", "ERROR", "INFO"
+    };
+    return slot_names;
+}
+
 Color ColorScheme::find_background_color(bool find_light) {
     Color color;
     float max_score = 0.0f;
@@ -244,17 +365,58 @@ void ColorScheme::generate_special_colors() {
     used_colors.push_back(info_color);
 }
 
-std::vector<std::string> ColorScheme::split_commands(const std::string &name) const {
-    std::vector<std::string> segments;
-    std::string current_segment;
-    for (char c: name) {
-        if (c == '.') {
-            segments.push_back(current_segment);
-            current_segment.clear();
-        } else {
-            current_segment += c;
+void ColorScheme::enforce_contrast() {
+    // the same targets generate() applies through adjust_min_contrast and adjust_contrast_color
+    float contrast = light_theme ? 3.0f : 7.0f;
+
+    auto enforce = [this](Color &color, float target_contrast) {
+        color.adjust_min_contrast(target_contrast, background_color, !light_theme);
+        if (color.calculate_contrast(background_color) < target_contrast) {
+            // adjust_min_contrast gives up short of white or black; near the middle of a transition the background can
+            // sit on either side of the theme switch, so whichever extreme reads better is taken
+            Color lighter = color, darker = color;
+            lighter.adjust_luminance(100.0f);
+            darker.adjust_luminance(-100.0f);
+            color = lighter.calculate_contrast(background_color) >= darker.calculate_contrast(background_color)
+                    ? lighter : darker;
         }
+    };
+
+    enforce(scheme_colors[0], 2.0f);
+    scheme_colors[8] = scheme_colors[0];
+    for (int color = 1; color <= 6; color++) {
+        enforce(scheme_colors[color], contrast);
+        scheme_colors[color + 8] = scheme_colors[color];
+    }
+
+    for (Color *color: {&accent_color, &error_color, &good_color, &warning_color, &info_color}) {
+        enforce(*color, contrast);
+    }
+
+    for (Color *color: {&text_color, &scheme_colors[7], &scheme_colors[15]}) {
+        enforce(*color, text_contrast);
+    }
+}
+
+Color *ColorScheme::find_slot(const std::string &name) {
+    if (name == "BACKGROUND") {
+        return &background_color;
+    } else if (name == "FOREGROUND") {
+        return &text_color;
+    } else if (name == "ACCENT") {
+        return &accent_color;
+    } else if (name == "GOOD") {
+        return &good_color;
+    } else if (name == "WARNING") {
+        return &warning_color;
+    } else if (name == "ERROR") {
+        return &error_color;
+    } else if (name == "INFO") {
+        return &info_color;
+    } else if (name.size() > 5 && name.size() <= 7 && name.compare(0, 5, "COLOR") == 0
+               && name.find_first_not_of("0123456789", 5) == std::string::npos) {
+        int value = std::stoi(name.substr(5));
+        return value <= 15 ? &scheme_colors[value] : nullptr;
     }
-    segments.push_back(current_segment);
-    return segments;
+    return nullptr;
 }
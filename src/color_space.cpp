@@ -0,0 +1,118 @@
+#include "color_space.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    const float lab_threshold = 0.008856f;
+
+    float lab_f(float t) {
+        return t > lab_threshold ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+    }
+
+    float lab_f_inverse(float f) {
+        float cube = f * f * f;
+        return cube > lab_threshold ? cube : (f - 16.0f / 116.0f) / 7.787f;
+    }
+
+    float gamma_channel(float linear) {
+        linear = std::clamp(linear, 0.0f, 1.0f);
+        if (linear <= 0.0031308f) {
+            return 12.92f * linear;
+        }
+        return 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    }
+}
+
+Vec3f ColorSpace::rgb_to_hls(const Vec3f &rgb) {
+    float r = rgb[0], g = rgb[1], b = rgb[2];
+    float vmax = std::max({r, g, b});
+    float vmin = std::min({r, g, b});
+    float diff = vmax - vmin;
+    float l = (vmax + vmin) * 0.5f;
+    float h = 0.0f, s = 0.0f;
+
+    if (diff > FLT_EPSILON) {
+        s = l < 0.5f ? diff / (vmax + vmin) : diff / (2.0f - vmax - vmin);
+        diff = 60.0f / diff;
+
+        if (vmax == r) {
+            h = (g - b) * diff;
+        } else if (vmax == g) {
+            h = (b - r) * diff + 120.0f;
+        } else {
+            h = (r - g) * diff + 240.0f;
+        }
+
+        if (h < 0.0f) {
+            h += 360.0f;
+        }
+    }
+
+    return {h, l, s};
+}
+
+Vec3f ColorSpace::hls_to_rgb(const Vec3f &hls) {
+    float h = hls[0], l = hls[1], s = hls[2];
+    if (s == 0.0f) {
+        return {l, l, l};
+    }
+
+    static const int sector_data[][3] = {{1, 3, 0}, {1, 0, 2}, {3, 0, 1}, {0, 2, 1}, {0, 1, 3}, {2, 1, 0}};
+
+    float p2 = l <= 0.5f ? l * (1.0f + s) : l + s - l * s;
+    float p1 = 2.0f * l - p2;
+
+    h /= 60.0f;
+    if (h < 0.0f) {
+        h += 6.0f;
+    } else if (h >= 6.0f) {
+        h -= 6.0f;
+    }
+
+    int sector = std::clamp((int) std::floor(h), 0, 5);
+    h -= (float) sector;
+
+    float tab[4] = {p2, p1, p1 + (p2 - p1) * (1.0f - h), p1 + (p2 - p1) * h};
+    return {tab[sector_data[sector][2]], tab[sector_data[sector][1]], tab[sector_data[sector][0]]};
+}
+
+Vec3f ColorSpace::rgb_to_lab(const Vec3f &rgb) {
+    float r = linearize_channel(rgb[0]);
+    float g = linearize_channel(rgb[1]);
+    float b = linearize_channel(rgb[2]);
+
+    float x = (0.412453f * r + 0.357580f * g + 0.180423f * b) / 0.950456f;
+    float y = 0.212671f * r + 0.715160f * g + 0.072169f * b;
+    float z = (0.019334f * r + 0.119193f * g + 0.950227f * b) / 1.088754f;
+
+    float fx = lab_f(x), fy = lab_f(y), fz = lab_f(z);
+    return {lab_lightness(y), 500.0f * (fx - fy), 200.0f * (fy - fz)};
+}
+
+Vec3f ColorSpace::lab_to_rgb(const Vec3f &lab) {
+    float fy = (lab[0] + 16.0f) / 116.0f;
+    float y = lab[0] > 903.3f * lab_threshold ? fy * fy * fy : lab[0] / 903.3f;
+    float x = lab_f_inverse(fy + lab[1] / 500.0f) * 0.950456f;
+    float z = lab_f_inverse(fy - lab[2] / 200.0f) * 1.088754f;
+
+    float r = 3.240479f * x - 1.537150f * y - 0.498535f * z;
+    float g = -0.969256f * x + 1.875991f * y + 0.041556f * z;
+    float b = 0.055648f * x - 0.204043f * y + 1.057311f * z;
+    return {gamma_channel(r), gamma_channel(g), gamma_channel(b)};
+}
+
+float ColorSpace::linearize_channel(float channel) {
+    if (channel <= 0.04045f) {
+        return channel / 12.92f;
+    }
+    return std::pow((channel + 0.055f) / 1.055f, 2.4f);
+}
+
+float ColorSpace::lab_lightness(float relative_luminance) {
+    if (relative_luminance > lab_threshold) {
+        return 116.0f * std::cbrt(relative_luminance) - 16.0f;
+    }
+    return 903.3f * relative_luminance;
+}
@@ -1,6 +1,6 @@
 #include "configurator.h"
-#include "writer.h"
-#include "parser.h"
+
+#include <iostream>
 
 void Configurator::load_config(const std::string &config_path) {
     if (!std::filesystem::exists(config_path)) {
@@ -38,20 +38,94 @@ void Configurator::load_config(const std::string &config_path) {
     }
 }
 
-void Configurator::configure(const ColorScheme &color_scheme) {
-    for (size_t i = 0; i < format_paths.size(); ++i) {
-        const std::string &format_path = format_paths[i];
-        const std::string &real_path = real_paths[i];
+void Configurator::prefetch() {
+    templates.clear();
+    for (const FormatGroup &group: format_groups) {
+        templates.push_back(Parser::scan(group.format_path));
+    }
 
-        std::string parsed_config = Parser::parse(format_path, color_scheme);
-        Writer::write(real_path, parsed_config);
+    std::vector<std::string> suffixes = {""};
+    if (variants) {
+        suffixes = {light_suffix, dark_suffix};
     }
+
+    // a hash learned in an earlier run stays valid while the file keeps the size and time it had then
+    std::unordered_map<std::string, Writer::FileState> states;
+    for (const FormatGroup &group: format_groups) {
+        for (const Destination &destination: group.destinations) {
+            for (const std::string &suffix: suffixes) {
+                std::string real_path = destination.real_path + suffix;
+                Writer::FileState state = Writer::stat(real_path);
+                auto previous = file_states.find(real_path);
+                if (previous != file_states.end() && previous->second.hash_known && state.exists
+                    && previous->second.size == state.size && previous->second.modified == state.modified) {
+                    state = previous->second;
+                }
+                states[real_path] = state;
+            }
+        }
+    }
+    file_states = std::move(states);
 }
 
-std::string Configurator::get_wallpaper_path() {
+void Configurator::configure(const ColorScheme &color_scheme, const std::string &suffix) {
+    std::string parsed_config;
+    for (size_t i = 0; i < format_groups.size(); ++i) {
+        parsed_config.clear();
+        if (i < templates.size()) {
+            Parser::render(templates[i], color_scheme, parsed_config);
+        } else {
+            Parser::render(Parser::scan(format_groups[i].format_path), color_scheme, parsed_config);
+        }
+        std::uint64_t content_hash = Writer::hash(parsed_config);
+
+        for (const Destination &destination: format_groups[i].destinations) {
+            const std::string real_path = destination.real_path + suffix;
+
+            auto state = file_states.find(real_path);
+            if (state == file_states.end()) {
+                state = file_states.emplace(real_path, Writer::stat(real_path)).first;
+            }
+            bool changed = Writer::write(real_path, parsed_config, content_hash, state->second);
+
+            // with variants a section is written twice, but its hook only has to run once
+            for (size_t section: destination.sections) {
+                if (changed && !sections[section].reload_command.empty()) {
+                    sections[section].reload_pending = true;
+                }
+            }
+        }
+    }
+}
+
+std::vector<HookRunner::Outcome> Configurator::reload() {
+    std::vector<HookRunner::Hook> hooks;
+    for (Section &section: sections) {
+        if (section.reload_pending) {
+            hooks.push_back({section.name, section.reload_command});
+            section.reload_pending = false;
+        }
+    }
+
+    return HookRunner(max_parallel_hooks, hook_timeout).run(hooks);
+}
+
+std::string Configurator::get_wallpaper_path() const {
     return wallpaper_path;
 }
 
+bool Configurator::has_variants() const {
+    return variants;
+}
+
+const std::string &Configurator::get_light_suffix() const {
+    return light_suffix;
+}
+
+const std::string &Configurator::get_dark_suffix() const {
+    return dark_suffix;
+}
+
 void Configurator::load_format(const std::string &section_name, const toml::value &section_data) {
     if (!section_data.contains("format_path") || !section_data.contains("real_path")) {
         throw std::runtime_error(
@@ -59,14 +133,42 @@ void Configurator::load_format(const std::string &section_name, const toml::valu
                 ")");
     }
 
-    if (section_data.size() != 2) {
+    bool has_reload = section_data.contains("reload");
+    if (section_data.size() != (has_reload ? 3 : 2)) {
         throw std::runtime_error(
-                "Config file section must only contain 'format_path' and 'real_path' fields (section: " +
+                "Config file section must only contain 'format_path', 'real_path' and 'reload' fields (section: " +
                 section_name + ")");
     }
 
-    format_paths.push_back(section_data.at("format_path").as_string());
-    real_paths.push_back(section_data.at("real_path").as_string());
+    std::string format_path = section_data.at("format_path").as_string();
+    std::string real_path = section_data.at("real_path").as_string();
+    sections.push_back({section_name, has_reload ? std::string(section_data.at("reload").as_string()) : ""});
+
+    std::string format_key = std::filesystem::weakly_canonical(format_path).string();
+    auto group_index = format_group_indices.find(format_key);
+    if (group_index == format_group_indices.end()) {
+        group_index = format_group_indices.emplace(format_key, format_groups.size()).first;
+        format_groups.push_back({format_path, {}});
+    }
+    FormatGroup &group = format_groups[group_index->second];
+
+    std::string real_key = std::filesystem::weakly_canonical(real_path).string();
+    auto destination_group = destination_groups.find(real_key);
+    if (destination_group == destination_groups.end()) {
+        destination_groups.emplace(real_key, group_index->second);
+        group.destinations.push_back({real_path, {sections.size() - 1}});
+        return;
+    }
+
+    if (destination_group->second != group_index->second) {
+        throw std::runtime_error("Config file sections with different 'format_path' fields write the same "
+                                 "'real_path' (section: " + section_name + ")");
+    }
+    for (Destination &destination: group.destinations) {
+        if (std::filesystem::weakly_canonical(destination.real_path).string() == real_key) {
+            destination.sections.push_back(sections.size() - 1);
+        }
+    }
 }
 
 void Configurator::load_wallpaper_path(const std::string &section_name, const toml::value &section_data) {
@@ -74,11 +176,68 @@ void Configurator::load_wallpaper_path(const std::string &section_name, const to
         throw std::runtime_error("Config file section must contain 'path' field (section: " + section_name + ")");
     }
 
-    if (section_data.size() != 1) {
-        throw std::runtime_error("Config file section must only contain 'path' field (section: " + section_name + ")");
+    // every other section name is free for format sections, so run-wide settings are sub-tables of this one
+    for (const auto &field: section_data.as_table()) {
+        if (field.first == "path") {
+            continue;
+        }
+
+        std::string table_name = section_name + "." + field.first;
+        if (field.first == "variants" && field.second.is_table()) {
+            load_variants(table_name, field.second);
+        } else if (field.first == "hooks" && field.second.is_table()) {
+            load_hooks(table_name, field.second);
+        } else {
+            throw std::runtime_error("Config file section must only contain 'path' field and 'variants' and "
+                                     "'hooks' tables (section: " + section_name + ")");
+        }
     }
 
     wallpaper_path = section_data.at("path").as_string();
 }
 
+void Configurator::load_variants(const std::string &section_name, const toml::value &section_data) {
+    for (const auto &field: section_data.as_table()) {
+        if (field.first != "light_suffix" && field.first != "dark_suffix") {
+            throw std::runtime_error(
+                    "Config file section must only contain 'light_suffix' and 'dark_suffix' fields (section: " +
+                    section_name + ")");
+        }
+    }
+
+    if (section_data.contains("light_suffix")) {
+        light_suffix = section_data.at("light_suffix").as_string();
+    }
+    if (section_data.contains("dark_suffix")) {
+        dark_suffix = section_data.at("dark_suffix").as_string();
+    }
 
+    if (light_suffix == dark_suffix) {
+        throw std::runtime_error("Light and dark suffixes must differ (section: " + section_name + ")");
+    }
+
+    variants = true;
+}
+
+void Configurator::load_hooks(const std::string &section_name, const toml::value &section_data) {
+    for (const auto &field: section_data.as_table()) {
+        if (field.first != "max_parallel" && field.first != "timeout_ms") {
+            throw std::runtime_error(
+                    "Config file section must only contain 'max_parallel' and 'timeout_ms' fields (section: " +
+                    section_name + ")");
+        }
+    }
+
+    if (section_data.contains("max_parallel")) {
+        max_parallel_hooks = (int) section_data.at("max_parallel").as_integer();
+        if (max_parallel_hooks < 1) {
+            throw std::runtime_error("'max_parallel' must be at least 1 (section: " + section_name + ")");
+        }
+    }
+    if (section_data.contains("timeout_ms")) {
+        hook_timeout = std::chrono::milliseconds(section_data.at("timeout_ms").as_integer());
+        if (hook_timeout.count() <= 0) {
+            throw std::runtime_error("'timeout_ms' must be positive (section: " + section_name + ")");
+        }
+    }
+}
@@ -0,0 +1,234 @@
+#include "evaluator.h"
+
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+namespace {
+    const uint64_t reference_seed = 0x9e3779b97f4a7c15ULL;
+    const uint64_t reseed_seed = 0x2545f4914f6cdd1dULL;
+    const int corpus_size = 12;
+    const int corpus_image_size = 256;
+
+    cv::Vec3b random_pixel(std::mt19937 &rng, int low, int high) {
+        std::uniform_int_distribution<int> channel(low, high);
+        return {(uchar) channel(rng), (uchar) channel(rng), (uchar) channel(rng)};
+    }
+
+    void fill_rect(cv::Mat &image, int x, int y, int width, int height, const cv::Vec3b &pixel) {
+        for (int row = y; row < std::min(y + height, image.rows); row++) {
+            for (int col = x; col < std::min(x + width, image.cols); col++) {
+                image.at<cv::Vec3b>(row, col) = pixel;
+            }
+        }
+    }
+}
+
+Evaluator::Evaluator(const Thresholds &thresholds) : thresholds(thresholds) { }
+
+void Evaluator::add_candidate(const std::string &name, const Generator &generator, bool gating) {
+    candidates.push_back({name, generator, gating});
+}
+
+bool Evaluator::run(std::ostream &out) {
+    std::vector<Image> corpus = generate_corpus();
+
+    std::vector<ColorScheme> reference_schemes;
+    auto start = std::chrono::steady_clock::now();
+    for (const Image &image: corpus) {
+        reference_schemes.push_back(generate_reference(image));
+    }
+    std::chrono::duration<double> reference_seconds = std::chrono::steady_clock::now() - start;
+
+    // the reference with another k-means seed differs from itself by seed noise alone, which no candidate is
+    // expected to beat
+    std::vector<ColorScheme> reseeded_schemes;
+    for (const Image &image: corpus) {
+        reseeded_schemes.push_back(generate_reference(image, reseed_seed));
+    }
+    float noise_floor = worst_slot_delta_e(reference_schemes, reseeded_schemes);
+    float max_delta_e = thresholds.max_delta_e >= 0.0f ? thresholds.max_delta_e
+                      : std::max(noise_floor * thresholds.noise_margin, thresholds.min_delta_e);
+
+    out << "corpus: " << corpus.size() << " images, reference: "
+        << reference_seconds.count() * 1000.0 << " ms" << std::endl;
+    out << "reseed noise floor: worst delta E " << noise_floor << std::endl;
+    out << "thresholds: max delta E " << max_delta_e
+        << (thresholds.max_delta_e >= 0.0f ? "" : " (derived)")
+        << ", min contrast " << thresholds.min_contrast << std::endl;
+
+    bool passed = true;
+    for (const Candidate &candidate: candidates) {
+        bool candidate_passed = evaluate_candidate(candidate, corpus, reference_schemes, reference_seconds.count(),
+                                                   max_delta_e, out);
+        if (!candidate_passed && candidate.gating) {
+            passed = false;
+        }
+    }
+
+    out << (passed ? "PASS" : "FAIL") << std::endl;
+    return passed;
+}
+
+ColorScheme Evaluator::generate_reference(const Image &image) {
+    return generate_reference(image, reference_seed);
+}
+
+ColorScheme Evaluator::generate_reference(const Image &image, uint64_t seed) {
+    // cv::kmeans draws its initial centers from the global RNG
+    cv::theRNG().state = seed;
+
+    ColorScheme color_scheme;
+    color_scheme.generate(image);
+    return color_scheme;
+}
+
+std::vector<Image> Evaluator::generate_corpus() {
+    std::vector<Image> corpus;
+    for (int i = 0; i < corpus_size; i++) {
+        std::mt19937 rng(i + 1);
+        cv::Mat image(corpus_image_size, corpus_image_size, CV_8UC3);
+        std::uniform_int_distribution<int> position(0, corpus_image_size - 1);
+        std::uniform_int_distribution<int> noise(-12, 12);
+
+        switch (i % 6) {
+            case 0:   // dark base with scattered blocks
+            case 1: { // light base with scattered blocks
+                bool light = i % 6 == 1;
+                fill_rect(image, 0, 0, image.cols, image.rows,
+                          random_pixel(rng, light ? 190 : 0, light ? 255 : 60));
+                for (int block = 0; block < 24; block++) {
+                    fill_rect(image, position(rng), position(rng), position(rng) / 3 + 4, position(rng) / 3 + 4,
+                              random_pixel(rng, 0, 255));
+                }
+                break;
+            }
+            case 2: { // noisy gradient between two colors
+                cv::Vec3b from = random_pixel(rng, 0, 255);
+                cv::Vec3b to = random_pixel(rng, 0, 255);
+                for (int row = 0; row < image.rows; row++) {
+                    for (int col = 0; col < image.cols; col++) {
+                        float t = (float) col / (float) (image.cols - 1);
+                        cv::Vec3b &pixel = image.at<cv::Vec3b>(row, col);
+                        for (int c = 0; c < 3; c++) {
+                            int value = (int) ((1.0f - t) * (float) from[c] + t * (float) to[c]) + noise(rng);
+                            pixel[c] = (uchar) std::clamp(value, 0, 255);
+                        }
+                    }
+                }
+                break;
+            }
+            case 3: { // posterized stripes from a small palette
+                std::vector<cv::Vec3b> palette;
+                for (int color = 0; color < 5; color++) {
+                    palette.push_back(random_pixel(rng, 0, 255));
+                }
+                for (int stripe = 0; stripe < 16; stripe++) {
+                    fill_rect(image, 0, stripe * 16, image.cols, 16, palette[rng() % palette.size()]);
+                }
+                break;
+            }
+            case 4: { // uniform noise
+                for (int row = 0; row < image.rows; row++) {
+                    for (int col = 0; col < image.cols; col++) {
+                        image.at<cv::Vec3b>(row, col) = random_pixel(rng, 0, 255);
+                    }
+                }
+                break;
+            }
+            default: { // near-monochrome
+                cv::Vec3b tint = random_pixel(rng, 0, 40);
+                std::uniform_int_distribution<int> gray(0, 215);
+                for (int row = 0; row < image.rows; row++) {
+                    int value = gray(rng);
+                    for (int col = 0; col < image.cols; col++) {
+                        image.at<cv::Vec3b>(row, col) = {(uchar) (value + tint[0]), (uchar) (value + tint[1]),
+                                                         (uchar) (value + tint[2])};
+                    }
+                }
+                break;
+            }
+        }
+
+        corpus.emplace_back(image);
+    }
+
+    return corpus;
+}
+
+float Evaluator::worst_slot_delta_e(const std::vector<ColorScheme> &from, const std::vector<ColorScheme> &to) {
+    float worst = 0.0f;
+    for (size_t image = 0; image < from.size(); image++) {
+        for (const std::string &slot: ColorScheme::get_slot_names()) {
+            Color from_color = from[image].name_to_color(slot).result;
+            worst = std::max(worst, from_color.calculate_distance(to[image].name_to_color(slot).result));
+        }
+    }
+    return worst;
+}
+
+bool Evaluator::evaluate_candidate(const Candidate &candidate, const std::vector<Image> &corpus,
+                                   const std::vector<ColorScheme> &reference_schemes, double reference_seconds,
+                                   float max_delta_e, std::ostream &out) const {
+    const std::vector<std::string> &slot_names = ColorScheme::get_slot_names();
+
+    std::vector<ColorScheme> candidate_schemes;
+    auto start = std::chrono::steady_clock::now();
+    for (const Image &image: corpus) {
+        candidate_schemes.push_back(candidate.generator(image));
+    }
+    std::chrono::duration<double> candidate_seconds = std::chrono::steady_clock::now() - start;
+
+    std::vector<SlotStats> slot_stats(slot_names.size());
+    int contrast_violations = 0;
+    int theme_mismatches = 0;
+    for (size_t image = 0; image < corpus.size(); image++) {
+        const ColorScheme &reference = reference_schemes[image];
+        const ColorScheme &result = candidate_schemes[image];
+        if (reference.is_light() != result.is_light()) {
+            theme_mismatches++;
+        }
+
+        Color reference_background = reference.name_to_color("BACKGROUND").result;
+        Color result_background = result.name_to_color("BACKGROUND").result;
+        for (size_t slot = 0; slot < slot_names.size(); slot++) {
+            Color reference_color = reference.name_to_color(slot_names[slot]).result;
+            Color result_color = result.name_to_color(slot_names[slot]).result;
+
+            float delta_e = reference_color.calculate_distance(result_color);
+            slot_stats[slot].max_delta_e = std::max(slot_stats[slot].max_delta_e, delta_e);
+            slot_stats[slot].total_delta_e += delta_e;
+
+            // only count slots where the reference itself meets the contrast requirement
+            if (slot_names[slot] != "BACKGROUND"
+                && reference_color.calculate_contrast(reference_background) >= thresholds.min_contrast
+                && result_color.calculate_contrast(result_background) < thresholds.min_contrast) {
+                contrast_violations++;
+            }
+        }
+    }
+
+    float worst_delta_e = 0.0f;
+    out << std::endl << "== " << candidate.name << " ==" << std::endl;
+    out << std::left << std::setw(12) << "slot" << std::right << std::setw(10) << "max dE"
+        << std::setw(10) << "mean dE" << std::endl;
+    for (size_t slot = 0; slot < slot_names.size(); slot++) {
+        const SlotStats &stats = slot_stats[slot];
+        worst_delta_e = std::max(worst_delta_e, stats.max_delta_e);
+        out << std::left << std::setw(12) << slot_names[slot] << std::right << std::fixed << std::setprecision(2)
+            << std::setw(10) << stats.max_delta_e
+            << std::setw(10) << stats.total_delta_e / (float) corpus.size() << std::endl;
+    }
+    out.unsetf(std::ios::fixed);
+    out << std::setprecision(6);
+
+    double speedup = candidate_seconds.count() > 0.0 ? reference_seconds / candidate_seconds.count() : 0.0;
+    out << "time: " << candidate_seconds.count() * 1000.0 << " ms (speedup " << speedup << "x)" << std::endl;
+    out << "theme mismatches: " << theme_mismatches << std::endl;
+    out << "contrast violations: " << contrast_violations << std::endl;
+
+    bool passed = worst_delta_e <= max_delta_e && contrast_violations == 0;
+    out << candidate.name << ": " << (passed ? "pass" : "fail") << (candidate.gating ? "" : " (informational)")
+        << " (worst dE " << worst_delta_e << ")" << std::endl;
+    return passed;
+}
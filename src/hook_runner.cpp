@@ -0,0 +1,140 @@
+#include "hook_runner.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // self-pipe the SIGCHLD handler writes to, so the wait loop can sleep in poll() until a child exits or times out
+    int child_exit_pipe[2] = {-1, -1};
+
+    void notify_child_exit(int) {
+        int saved_errno = errno;
+        char byte = 0;
+        ssize_t ignored = write(child_exit_pipe[1], &byte, 1);
+        (void) ignored;
+        errno = saved_errno;
+    }
+
+    struct RunningHook {
+        size_t index;
+        pid_t pid;
+        Clock::time_point start;
+        bool killed;
+    };
+
+    pid_t spawn(const std::string &command) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // own process group, so a timeout also takes down whatever the command started
+            setpgid(0, 0);
+            int null_fd = open("/dev/null", O_RDONLY);
+            if (null_fd >= 0) {
+                dup2(null_fd, STDIN_FILENO);
+                close(null_fd);
+            }
+            execl("/bin/sh", "sh", "-c", command.c_str(), (char *) nullptr);
+            _exit(127);
+        }
+        if (pid > 0) {
+            setpgid(pid, pid);
+        }
+        return pid;
+    }
+}
+
+HookRunner::HookRunner(int max_parallel, std::chrono::milliseconds timeout)
+        : max_parallel(std::max(max_parallel, 1)), timeout(timeout) { }
+
+std::vector<HookRunner::Outcome> HookRunner::run(const std::vector<Hook> &hooks) const {
+    std::vector<Outcome> outcomes(hooks.size());
+    if (hooks.empty()) {
+        return outcomes;
+    }
+
+    if (pipe2(child_exit_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw std::runtime_error("Failed to create pipe for reload hooks: " + std::string(std::strerror(errno)));
+    }
+
+    struct sigaction action{}, previous_action{};
+    action.sa_handler = notify_child_exit;
+    action.sa_flags = SA_NOCLDSTOP | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, &previous_action);
+
+    std::vector<RunningHook> running;
+    size_t next = 0;
+    while (next < hooks.size() || !running.empty()) {
+        while (running.size() < (size_t) max_parallel && next < hooks.size()) {
+            outcomes[next].name = hooks[next].name;
+            Clock::time_point start = Clock::now();
+            pid_t pid = spawn(hooks[next].command);
+            if (pid < 0) {
+                outcomes[next].exit_status = 127;
+            } else {
+                running.push_back({next, pid, start, false});
+            }
+            next++;
+        }
+
+        bool reaped = false;
+        for (auto hook = running.begin(); hook != running.end();) {
+            int status;
+            if (waitpid(hook->pid, &status, WNOHANG) != hook->pid) {
+                ++hook;
+                continue;
+            }
+
+            Outcome &outcome = outcomes[hook->index];
+            outcome.exit_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+            outcome.timed_out = hook->killed;
+            outcome.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - hook->start).count();
+            hook = running.erase(hook);
+            reaped = true;
+        }
+        if (reaped) {
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = Clock::time_point::max();
+        for (RunningHook &hook: running) {
+            if (hook.killed) {
+                continue;
+            }
+            if (now >= hook.start + timeout) {
+                kill(-hook.pid, SIGKILL);
+                hook.killed = true;
+            } else {
+                wake = std::min(wake, hook.start + timeout);
+            }
+        }
+
+        int wait_ms = -1;
+        if (wake != Clock::time_point::max()) {
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(wake - now);
+            wait_ms = (int) std::max<long long>(remaining.count(), 0);
+        }
+
+        pollfd poll_fd{child_exit_pipe[0], POLLIN, 0};
+        if (poll(&poll_fd, 1, wait_ms) > 0) {
+            char buffer[64];
+            while (read(child_exit_pipe[0], buffer, sizeof(buffer)) > 0) { }
+        }
+    }
+
+    sigaction(SIGCHLD, &previous_action, nullptr);
+    close(child_exit_pipe[0]);
+    close(child_exit_pipe[1]);
+    child_exit_pipe[0] = child_exit_pipe[1] = -1;
+
+    return outcomes;
+}
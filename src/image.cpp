@@ -1,21 +1,78 @@
 #include "image.h"
 
+#ifdef HUEMASTER_LITE_IMAGE
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "color_space.h"
+#include "image_decoder.h"
+#endif
+
+#ifdef HUEMASTER_LITE_IMAGE
+namespace {
+    struct AreaWeight {
+        int source;
+        float weight;
+    };
+
+    // For every destination index, the source indices covered by its box and their coverage fractions.
+    std::vector<std::vector<AreaWeight>> area_weights(int source_size, int target_size) {
+        std::vector<std::vector<AreaWeight>> weights(target_size);
+        double scale = (double) source_size / (double) target_size;
+        for (int target = 0; target < target_size; target++) {
+            double begin = target * scale;
+            double end = std::min((target + 1) * scale, (double) source_size);
+            if (scale < 1.0) {
+                // upscaling: every destination pixel lies within a single source pixel
+                weights[target].push_back({std::min((int) begin, source_size - 1), 1.0f});
+                continue;
+            }
+
+            for (int source = (int) begin; source < (int) std::ceil(end); source++) {
+                double coverage = std::min(end, source + 1.0) - std::max(begin, (double) source);
+                if (coverage > 1e-9) {
+                    weights[target].push_back({source, (float) (coverage / scale)});
+                }
+            }
+        }
+        return weights;
+    }
+}
+#endif
+
 Image::Image(const std::string &path) {
     if (!std::filesystem::exists(path)) {
         throw std::runtime_error("File does not exist: '" + path + "'");
     }
 
+#ifdef HUEMASTER_LITE_IMAGE
+    ImageDecoder::DecodedImage decoded = ImageDecoder::decode(path);
+    width = decoded.width;
+    height = decoded.height;
+    pixels = std::move(decoded.pixels);
+    if (pixels.empty()) {
+        throw std::runtime_error("Could not read image: '" + path + "'");
+    }
+#else
     image = cv::imread(path, cv::IMREAD_COLOR);
     if (image.empty()) {
         throw std::runtime_error("Could not read image: '" + path + "'");
     }
 
     cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+#endif
 }
 
+#ifndef HUEMASTER_LITE_IMAGE
+Image::Image(cv::Mat rgb_image) : image(std::move(rgb_image)) { }
+#endif
+
 std::vector<Color> Image::get_dominant_colors() const {
     const int num_colors = 32;
 
+#ifdef HUEMASTER_LITE_IMAGE
+    return get_dominant_colors(KMeans(num_colors, 10, 1.0f, 3));
+#else
     cv::Mat reshaped = image.reshape(1, image.cols * image.rows);
     cv::Mat reshaped32f;
     reshaped.convertTo(reshaped32f, CV_32F);
@@ -36,17 +93,90 @@ std::vector<Color> Image::get_dominant_colors() const {
     }
 
     return dominant_colors;
+#endif
+}
+
+std::vector<Color> Image::get_dominant_colors(const KMeans &kmeans) const {
+    return extract_dominant_colors(kmeans).colors;
+}
+
+Image::Extraction Image::extract_dominant_colors(const KMeans &kmeans) const {
+    std::vector<float> samples = get_samples();
+    KMeans::Result clusters = kmeans.cluster(samples);
+
+    float total_pixels = (float) (samples.size() / 3);
+
+    Extraction extraction{{}, clusters.termination, clusters.iterations};
+    for (size_t i = 0; i < clusters.centers.size(); i++) {
+        float proportion = (float) clusters.counts[i] / total_pixels;
+        extraction.colors.emplace_back(clusters.centers[i], proportion);
+    }
+
+    return extraction;
 }
 
 float Image::calculate_mean_luminance() const {
+#ifdef HUEMASTER_LITE_IMAGE
+    std::array<float, 256> linear{};
+    for (int value = 0; value < 256; value++) {
+        linear[value] = ColorSpace::linearize_channel((float) value / 255.0f);
+    }
+
+    double total_lightness = 0.0;
+    for (size_t i = 0; i + 2 < pixels.size(); i += 3) {
+        float luminance = 0.212671f * linear[pixels[i]] + 0.715160f * linear[pixels[i + 1]]
+                          + 0.072169f * linear[pixels[i + 2]];
+        total_lightness += ColorSpace::lab_lightness(luminance);
+    }
+
+    size_t total_pixels = pixels.size() / 3;
+    return total_pixels == 0 ? 0.0f : (float) (total_lightness / (double) total_pixels / 100.0);
+#else
     cv::Mat lab_image;
     cv::cvtColor(image, lab_image, cv::COLOR_RGB2Lab);
     cv::Scalar mean_lab = cv::mean(lab_image);
     return (float) mean_lab[0] / 255.0f;
+#endif
 }
 
 void Image::resize(int width, int height) {
+#ifdef HUEMASTER_LITE_IMAGE
+    // box filter weighted by pixel coverage, the same idea as cv::INTER_AREA
+    std::vector<std::vector<AreaWeight>> column_weights = area_weights(this->width, width);
+    std::vector<std::vector<AreaWeight>> row_weights = area_weights(this->height, height);
+
+    std::vector<float> rows((size_t) this->height * width * 3);
+    for (int y = 0; y < this->height; y++) {
+        const unsigned char *source_row = &pixels[(size_t) y * this->width * 3];
+        float *target_row = &rows[(size_t) y * width * 3];
+        for (int x = 0; x < width; x++) {
+            float sum[3] = {0.0f, 0.0f, 0.0f};
+            for (const AreaWeight &weight: column_weights[x]) {
+                for (int channel = 0; channel < 3; channel++) {
+                    sum[channel] += weight.weight * source_row[weight.source * 3 + channel];
+                }
+            }
+            std::copy(sum, sum + 3, target_row + x * 3);
+        }
+    }
+
+    std::vector<unsigned char> resized((size_t) height * width * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width * 3; x++) {
+            float sum = 0.0f;
+            for (const AreaWeight &weight: row_weights[y]) {
+                sum += weight.weight * rows[(size_t) weight.source * width * 3 + x];
+            }
+            resized[(size_t) y * width * 3 + x] = (unsigned char) std::clamp((int) std::lround(sum), 0, 255);
+        }
+    }
+
+    this->width = width;
+    this->height = height;
+    pixels = std::move(resized);
+#else
     cv::resize(image, image, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+#endif
 }
 
 bool Image::is_light() const {
@@ -54,3 +184,21 @@ bool Image::is_light() const {
     const float light_threshold = 0.5f;
     return mean_luminance >= light_threshold;
 }
+
+std::vector<float> Image::get_samples() const {
+#ifdef HUEMASTER_LITE_IMAGE
+    return {pixels.begin(), pixels.end()};
+#else
+    std::vector<float> samples;
+    samples.reserve((size_t) image.rows * image.cols * 3);
+    for (int row = 0; row < image.rows; row++) {
+        const cv::Vec3b *pixel = image.ptr<cv::Vec3b>(row);
+        for (int col = 0; col < image.cols; col++) {
+            samples.push_back(pixel[col][0]);
+            samples.push_back(pixel[col][1]);
+            samples.push_back(pixel[col][2]);
+        }
+    }
+    return samples;
+#endif
+}
@@ -0,0 +1,121 @@
+#include "image_decoder.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <jpeglib.h>
+#include <png.h>
+#ifdef HUEMASTER_HAVE_WEBP
+#include <webp/decode.h>
+#endif
+
+namespace {
+    struct JpegErrorManager {
+        jpeg_error_mgr manager;
+        std::jmp_buf jump_buffer;
+    };
+
+    void jpeg_error_exit(j_common_ptr info) {
+        // libjpeg would otherwise exit() the process
+        std::longjmp(reinterpret_cast<JpegErrorManager *>(info->err)->jump_buffer, 1);
+    }
+
+    bool has_prefix(const std::vector<unsigned char> &data, size_t offset, const char *prefix, size_t length) {
+        return data.size() >= offset + length
+               && std::equal(prefix, prefix + length, data.begin() + offset,
+                             [](char expected, unsigned char actual) { return (unsigned char) expected == actual; });
+    }
+}
+
+ImageDecoder::DecodedImage ImageDecoder::decode(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not read image: '" + path + "'");
+    }
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (has_prefix(data, 0, "\xff\xd8\xff", 3)) {
+        return decode_jpeg(data, path);
+    } else if (has_prefix(data, 0, "\x89PNG\r\n\x1a\n", 8)) {
+        return decode_png(data, path);
+    } else if (has_prefix(data, 0, "RIFF", 4) && has_prefix(data, 8, "WEBP", 4)) {
+        return decode_webp(data, path);
+    }
+
+    throw std::runtime_error("Could not read image (unsupported format): '" + path + "'");
+}
+
+ImageDecoder::DecodedImage ImageDecoder::decode_jpeg(const std::vector<unsigned char> &data,
+                                                     const std::string &path) {
+    DecodedImage decoded;
+    jpeg_decompress_struct info{};
+    JpegErrorManager error{};
+
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpeg_error_exit;
+    if (setjmp(error.jump_buffer)) {
+        jpeg_destroy_decompress(&info);
+        throw std::runtime_error("Could not read image: '" + path + "'");
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char *>(data.data()), (unsigned long) data.size());
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+
+    decoded.width = (int) info.output_width;
+    decoded.height = (int) info.output_height;
+    decoded.pixels.resize((size_t) decoded.width * decoded.height * 3);
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = &decoded.pixels[(size_t) info.output_scanline * decoded.width * 3];
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return decoded;
+}
+
+ImageDecoder::DecodedImage ImageDecoder::decode_png(const std::vector<unsigned char> &data,
+                                                    const std::string &path) {
+    png_image image{};
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data.data(), data.size())) {
+        throw std::runtime_error("Could not read image: '" + path + "' (" + image.message + ")");
+    }
+
+    image.format = PNG_FORMAT_RGB;
+    DecodedImage decoded;
+    decoded.width = (int) image.width;
+    decoded.height = (int) image.height;
+    decoded.pixels.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, nullptr, decoded.pixels.data(), 0, nullptr)) {
+        png_image_free(&image);
+        throw std::runtime_error("Could not read image: '" + path + "' (" + image.message + ")");
+    }
+
+    return decoded;
+}
+
+ImageDecoder::DecodedImage ImageDecoder::decode_webp(const std::vector<unsigned char> &data,
+                                                     const std::string &path) {
+#ifdef HUEMASTER_HAVE_WEBP
+    DecodedImage decoded;
+    uint8_t *pixels = WebPDecodeRGB(data.data(), data.size(), &decoded.width, &decoded.height);
+    if (pixels == nullptr) {
+        throw std::runtime_error("Could not read image: '" + path + "'");
+    }
+
+    decoded.pixels.assign(pixels, pixels + (size_t) decoded.width * decoded.height * 3);
+    WebPFree(pixels);
+    return decoded;
+#else
+    (void) data;
+    throw std::runtime_error("Could not read image (built without WebP support): '" + path + "'");
+#endif
+}
@@ -0,0 +1,399 @@
+#include "kmeans.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include "worker_pool.h"
+
+namespace {
+    // size of the subsample a time-budgeted run builds its first palette from
+    const int coarse_sample_count = 4096;
+
+    // Samples are processed in fixed blocks whatever the thread count, and per-block partial sums are combined in
+    // block order, so the floating-point results (and with them the clustering) do not depend on the thread count.
+    const int block_size = 16384;
+
+    int block_count(int num_samples) {
+        return (num_samples + block_size - 1) / block_size;
+    }
+
+    inline float squared_distance(const float *a, const float *b) {
+        float d0 = a[0] - b[0], d1 = a[1] - b[1], d2 = a[2] - b[2];
+        return d0 * d0 + d1 * d1 + d2 * d2;
+    }
+}
+
+KMeans::KMeans(int num_clusters, int max_iterations, float epsilon, int attempts, uint64_t seed)
+        : num_clusters(num_clusters), max_iterations(max_iterations), epsilon(epsilon), attempts(attempts),
+          seed(seed) { }
+
+void KMeans::set_time_budget(std::chrono::microseconds budget) {
+    time_budget = budget;
+}
+
+void KMeans::set_threads(int threads) {
+    this->threads = threads > 0 ? threads : (int) std::max(1u, std::thread::hardware_concurrency());
+}
+
+KMeans::Result KMeans::cluster(const std::vector<float> &samples) const {
+    if (samples.size() < 3 || samples.size() % 3 != 0) {
+        throw std::runtime_error("k-means needs at least one 3-channel sample");
+    }
+
+    if (time_budget == std::chrono::microseconds::max()) {
+        return run_attempts(samples, Clock::time_point::max());
+    }
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + time_budget;
+    int num_samples = (int) (samples.size() / 3);
+    if (num_samples < 2 * coarse_sample_count) {
+        return run_attempts(samples, deadline);
+    }
+
+    int stride = num_samples / coarse_sample_count;
+    std::vector<float> coarse_samples;
+    coarse_samples.reserve(3 * (size_t) coarse_sample_count);
+    for (int i = 0; i < coarse_sample_count; i++) {
+        coarse_samples.insert(coarse_samples.end(), &samples[3 * i * stride], &samples[3 * i * stride + 3]);
+    }
+
+    Result result = run_attempts(coarse_samples, deadline);
+
+    // scale the subsample's counts up so the coarse palette's proportions stand in for the full image
+    for (int &count: result.counts) {
+        count = (int) ((int64_t) count * num_samples / coarse_sample_count);
+    }
+    if (result.termination == Termination::deadline) {
+        return result;
+    }
+
+    // assign and update cost scale with the sample count; seeding costs about two iterations per attempt
+    Clock::duration coarse_cost = Clock::now() - start;
+    Clock::duration iteration_cost = coarse_cost / (result.iterations + 2 * std::max(attempts, 1))
+                                     * (num_samples / coarse_sample_count);
+    WorkerPool pool(std::min(threads, block_count(num_samples)));
+    refine(samples, deadline, iteration_cost, result, pool);
+
+    return result;
+}
+
+KMeans::Result KMeans::run_attempts(const std::vector<float> &samples, Clock::time_point deadline) const {
+    int num_attempts = std::max(attempts, 1);
+    int num_blocks = block_count((int) (samples.size() / 3));
+    std::vector<Result> results;
+    if (threads > 1 && num_attempts > 1 && deadline == Clock::time_point::max()) {
+        // every attempt has its own seed, so without a deadline running them side by side changes nothing but the
+        // wall time; with one, attempts are admitted one after another by the same rule whatever the thread count
+        int concurrent_attempts = std::min(threads, num_attempts);
+        int attempt_threads = std::min(std::max(1, threads / concurrent_attempts), num_blocks);
+        results.resize(num_attempts);
+        WorkerPool attempt_pool(concurrent_attempts);
+        attempt_pool.run(num_attempts, [&](int attempt) {
+            WorkerPool pool(attempt_threads);
+            std::mt19937_64 rng(seed + attempt);
+            results[attempt] = run_attempt(samples, rng, deadline, pool);
+        });
+    } else {
+        WorkerPool pool(std::min(threads, num_blocks));
+        Clock::duration first_attempt_cost{};
+        for (int attempt = 0; attempt < num_attempts; attempt++) {
+            // the first attempt always runs so there is a palette; later ones only if the first one's cost still fits
+            Clock::time_point attempt_start = Clock::now();
+            if (attempt > 0 && attempt_start + first_attempt_cost > deadline) {
+                results.back().termination = Termination::deadline;
+                break;
+            }
+
+            std::mt19937_64 rng(seed + attempt);
+            results.push_back(run_attempt(samples, rng, deadline, pool));
+            if (attempt == 0) {
+                first_attempt_cost = Clock::now() - attempt_start;
+            }
+            if (results.back().termination == Termination::deadline) {
+                break;
+            }
+        }
+    }
+
+    // the first attempt with the lowest compactness wins, as it would if they ran one after another
+    size_t best = 0;
+    int iterations = 0;
+    bool hit_deadline = false;
+    bool hit_iteration_limit = false;
+    for (size_t attempt = 0; attempt < results.size(); attempt++) {
+        iterations += results[attempt].iterations;
+        hit_deadline |= results[attempt].termination == Termination::deadline;
+        hit_iteration_limit |= results[attempt].termination == Termination::iteration_limit;
+        if (results[attempt].compactness < results[best].compactness) {
+            best = attempt;
+        }
+    }
+
+    Result result = std::move(results[best]);
+    result.iterations = iterations;
+    result.termination = hit_deadline ? Termination::deadline
+                       : hit_iteration_limit ? Termination::iteration_limit
+                       : Termination::converged;
+    return result;
+}
+
+KMeans::Result KMeans::run_attempt(const std::vector<float> &samples, std::mt19937_64 &rng,
+                                   Clock::time_point deadline, WorkerPool &pool) const {
+    int num_samples = (int) (samples.size() / 3);
+    int k = std::min(num_clusters, num_samples);
+
+    std::vector<float> centers = initial_centers(samples, k, rng, pool);
+    std::vector<int> labels(num_samples);
+    double compactness = assign(samples, centers, labels, pool);
+
+    Result result;
+    result.termination = Termination::iteration_limit;
+    Clock::time_point iteration_start = Clock::now();
+    Clock::duration iteration_cost{};
+    for (int iteration = 1; iteration < std::max(max_iterations, 2); iteration++) {
+        // labels and centers always match after assign, so stopping here leaves a consistent palette
+        if (iteration_start + iteration_cost > deadline) {
+            result.termination = Termination::deadline;
+            break;
+        }
+
+        float max_shift = update_centers(samples, labels, centers, pool);
+        compactness = assign(samples, centers, labels, pool);
+        result.iterations++;
+
+        Clock::time_point now = Clock::now();
+        iteration_cost = now - iteration_start;
+        iteration_start = now;
+
+        if (max_shift <= epsilon * epsilon) {
+            result.termination = Termination::converged;
+            break;
+        }
+    }
+
+    result.compactness = compactness;
+    result.counts.assign(k, 0);
+    for (int label: labels) {
+        result.counts[label]++;
+    }
+    for (int c = 0; c < k; c++) {
+        result.centers.emplace_back(centers[3 * c], centers[3 * c + 1], centers[3 * c + 2]);
+    }
+
+    return result;
+}
+
+void KMeans::refine(const std::vector<float> &samples, Clock::time_point deadline, Clock::duration iteration_cost,
+                    Result &result, WorkerPool &pool) const {
+    int num_samples = (int) (samples.size() / 3);
+    int k = (int) result.centers.size();
+
+    std::vector<float> centers;
+    centers.reserve(3 * k);
+    for (const Vec3f &center: result.centers) {
+        centers.insert(centers.end(), {center[0], center[1], center[2]});
+    }
+    std::vector<int> labels(num_samples);
+
+    result.termination = Termination::iteration_limit;
+    Clock::time_point iteration_start = Clock::now();
+    for (int iteration = 0; iteration < std::max(max_iterations, 2); iteration++) {
+        if (iteration_start + iteration_cost > deadline) {
+            result.termination = Termination::deadline;
+            return;
+        }
+
+        // the palette is published right after assign, when centers and counts agree
+        result.compactness = assign(samples, centers, labels, pool);
+        result.counts.assign(k, 0);
+        for (int label: labels) {
+            result.counts[label]++;
+        }
+        for (int c = 0; c < k; c++) {
+            result.centers[c] = Vec3f(centers[3 * c], centers[3 * c + 1], centers[3 * c + 2]);
+        }
+
+        float max_shift = update_centers(samples, labels, centers, pool);
+        result.iterations++;
+
+        Clock::time_point now = Clock::now();
+        iteration_cost = now - iteration_start;
+        iteration_start = now;
+
+        if (max_shift <= epsilon * epsilon) {
+            result.termination = Termination::converged;
+            return;
+        }
+    }
+}
+
+std::vector<float> KMeans::initial_centers(const std::vector<float> &samples, int num_clusters,
+                                           std::mt19937_64 &rng, WorkerPool &pool) {
+    int num_samples = (int) (samples.size() / 3);
+    int num_blocks = block_count(num_samples);
+    std::vector<float> centers;
+    centers.reserve(3 * num_clusters);
+
+    std::uniform_int_distribution<int> uniform_index(0, num_samples - 1);
+    int first = uniform_index(rng);
+    centers.insert(centers.end(), &samples[3 * first], &samples[3 * first + 3]);
+
+    std::vector<float> distances(num_samples, std::numeric_limits<float>::max());
+    std::vector<double> block_totals(num_blocks);
+    auto update_distances = [&](const float *center) {
+        pool.run(num_blocks, [&](int block) {
+            int end = std::min(num_samples, (block + 1) * block_size);
+            double total = 0.0;
+            for (int i = block * block_size; i < end; i++) {
+                distances[i] = std::min(distances[i], squared_distance(&samples[3 * i], center));
+                total += distances[i];
+            }
+            block_totals[block] = total;
+        });
+    };
+    update_distances(&centers[0]);
+
+    // k-means++: pick each further center with probability proportional to its squared distance
+    for (int c = 1; c < num_clusters; c++) {
+        double total = 0.0;
+        for (double block_total: block_totals) {
+            total += block_total;
+        }
+
+        int chosen = num_samples - 1;
+        if (total <= 0.0) {
+            chosen = uniform_index(rng);
+        } else {
+            double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+            for (int i = 0; i < num_samples; i++) {
+                target -= distances[i];
+                if (target <= 0.0) {
+                    chosen = i;
+                    break;
+                }
+            }
+        }
+
+        centers.insert(centers.end(), &samples[3 * chosen], &samples[3 * chosen + 3]);
+        update_distances(&centers[3 * c]);
+    }
+
+    return centers;
+}
+
+double KMeans::assign(const std::vector<float> &samples, const std::vector<float> &centers,
+                      std::vector<int> &labels, WorkerPool &pool) {
+    int num_samples = (int) labels.size();
+    int num_blocks = block_count(num_samples);
+    int k = (int) (centers.size() / 3);
+
+    std::vector<double> block_compactness(num_blocks);
+    pool.run(num_blocks, [&](int block) {
+        int end = std::min(num_samples, (block + 1) * block_size);
+        double compactness = 0.0;
+        for (int i = block * block_size; i < end; i++) {
+            const float *sample = &samples[3 * i];
+            int best_label = 0;
+            float best_distance = std::numeric_limits<float>::max();
+            for (int c = 0; c < k; c++) {
+                float distance = squared_distance(sample, &centers[3 * c]);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best_label = c;
+                }
+            }
+            labels[i] = best_label;
+            compactness += best_distance;
+        }
+        block_compactness[block] = compactness;
+    });
+
+    double compactness = 0.0;
+    for (double partial: block_compactness) {
+        compactness += partial;
+    }
+    return compactness;
+}
+
+float KMeans::update_centers(const std::vector<float> &samples, std::vector<int> &labels,
+                             std::vector<float> &centers, WorkerPool &pool) {
+    int num_samples = (int) labels.size();
+    int num_blocks = block_count(num_samples);
+    int k = (int) (centers.size() / 3);
+
+    std::vector<double> block_sums((size_t) num_blocks * 3 * k, 0.0);
+    std::vector<int> block_counts((size_t) num_blocks * k, 0);
+    pool.run(num_blocks, [&](int block) {
+        double *partial_sums = &block_sums[(size_t) block * 3 * k];
+        int *partial_counts = &block_counts[(size_t) block * k];
+        int end = std::min(num_samples, (block + 1) * block_size);
+        for (int i = block * block_size; i < end; i++) {
+            int label = labels[i];
+            partial_sums[3 * label] += samples[3 * i];
+            partial_sums[3 * label + 1] += samples[3 * i + 1];
+            partial_sums[3 * label + 2] += samples[3 * i + 2];
+            partial_counts[label]++;
+        }
+    });
+
+    std::vector<double> sums(3 * k, 0.0);
+    std::vector<int> counts(k, 0);
+    for (int block = 0; block < num_blocks; block++) {
+        for (int c = 0; c < k; c++) {
+            for (int channel = 0; channel < 3; channel++) {
+                sums[3 * c + channel] += block_sums[((size_t) block * k + c) * 3 + channel];
+            }
+            counts[c] += block_counts[(size_t) block * k + c];
+        }
+    }
+
+    // an empty cluster takes over the sample that is worst served by its current center
+    for (int c = 0; c < k; c++) {
+        if (counts[c] > 0) {
+            continue;
+        }
+
+        int farthest = -1;
+        float farthest_distance = -1.0f;
+        for (int i = 0; i < num_samples; i++) {
+            if (counts[labels[i]] <= 1) {
+                continue;
+            }
+            float distance = squared_distance(&samples[3 * i], &centers[3 * labels[i]]);
+            if (distance > farthest_distance) {
+                farthest_distance = distance;
+                farthest = i;
+            }
+        }
+        if (farthest < 0) {
+            continue;
+        }
+
+        int old_label = labels[farthest];
+        for (int channel = 0; channel < 3; channel++) {
+            sums[3 * old_label + channel] -= samples[3 * farthest + channel];
+            sums[3 * c + channel] += samples[3 * farthest + channel];
+        }
+        counts[old_label]--;
+        counts[c]++;
+        labels[farthest] = c;
+    }
+
+    float max_shift = 0.0f;
+    for (int c = 0; c < k; c++) {
+        if (counts[c] == 0) {
+            continue;
+        }
+
+        float updated[3];
+        for (int channel = 0; channel < 3; channel++) {
+            updated[channel] = (float) (sums[3 * c + channel] / counts[c]);
+        }
+        max_shift = std::max(max_shift, squared_distance(updated, &centers[3 * c]));
+        std::copy(updated, updated + 3, &centers[3 * c]);
+    }
+
+    return max_shift;
+}
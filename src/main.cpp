@@ -1,27 +1,572 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <future>
+#include <limits>
+#include <sstream>
+#include <thread>
 #include "image.h"
 #include "color_scheme.h"
 #include "configurator.h"
+#include "palette_client.h"
+#include "palette_index.h"
+#include "palette_server.h"
+#include "self_check.h"
+#ifndef HUEMASTER_LITE_IMAGE
+#include "evaluator.h"
+#endif
 
-int main() {
-    try {
+namespace {
+    float parse_float_argument(const std::string &flag, const char *value) {
+        if (value == nullptr) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+
+        // unlike std::stof, from_chars does not skip trailing junk; it does read "nan" and "inf", which no flag takes
+        float parsed;
+        const char *end = value + std::strlen(value);
+        std::from_chars_result result = std::from_chars(value, end, parsed);
+        if (result.ec != std::errc() || result.ptr != end || value == end || !std::isfinite(parsed)) {
+            throw std::runtime_error("Invalid value for " + flag + ": " + value);
+        }
+        return parsed;
+    }
+
+    size_t parse_count_argument(const std::string &flag, const char *value) {
+        if (value == nullptr) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+
+        // from_chars rejects signs, fractions and out-of-range values for an unsigned type
+        size_t count;
+        const char *end = value + std::strlen(value);
+        std::from_chars_result result = std::from_chars(value, end, count);
+        if (result.ec != std::errc() || result.ptr != end || value == end) {
+            throw std::runtime_error("Invalid value for " + flag + ": " + value);
+        }
+        return count;
+    }
+
+    int parse_int_argument(const std::string &flag, const char *value, int min, int max) {
+        if (value == nullptr) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+
+        int parsed;
+        const char *end = value + std::strlen(value);
+        std::from_chars_result result = std::from_chars(value, end, parsed);
+        if (result.ec != std::errc() || result.ptr != end || value == end || parsed < min || parsed > max) {
+            throw std::runtime_error("Invalid value for " + flag + " (" + std::to_string(min) + " to "
+                                     + std::to_string(max) + "): " + value);
+        }
+        return parsed;
+    }
+
+#ifndef HUEMASTER_LITE_IMAGE
+    int run_evaluation(int argc, char *argv[]) {
+        Evaluator::Thresholds thresholds;
+        for (int i = 2; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--max-delta-e") {
+                thresholds.max_delta_e = parse_float_argument(flag, argv[++i]);
+            } else if (flag == "--min-contrast") {
+                thresholds.min_contrast = parse_float_argument(flag, argv[++i]);
+            } else {
+                throw std::runtime_error("Unknown argument: " + flag);
+            }
+        }
+
+        Evaluator evaluator(thresholds);
+
+        // the HLS/Lab math the lite build is compiled with, first alone and then with the lite build's k-means
+        evaluator.add_candidate("in-tree-color-space", [](const Image &image) {
+            Color::InTreeColorSpaceScope in_tree_color_space;
+            return Evaluator::generate_reference(image);
+        });
+
+        evaluator.add_candidate("lite-pipeline", [](const Image &image) {
+            Color::InTreeColorSpaceScope in_tree_color_space;
+            ColorScheme color_scheme;
+            color_scheme.generate(image.get_dominant_colors(KMeans(32, 10, 1.0f, 3)), image.is_light());
+            return color_scheme;
+        });
+
+        evaluator.add_candidate("in-tree-kmeans", [](const Image &image) {
+            ColorScheme color_scheme;
+            color_scheme.generate(image.get_dominant_colors(KMeans(32, 10, 1.0f, 3)), image.is_light());
+            return color_scheme;
+        });
+
+        // what a tight --max-extract-ms budget costs in palette quality; its palette depends on how much work fits in
+        // 5 ms on this machine right now, so it is reported but does not decide the exit status
+        evaluator.add_candidate("in-tree-kmeans-5ms", [](const Image &image) {
+            KMeans kmeans(32, 10, 1.0f, 3);
+            kmeans.set_time_budget(std::chrono::milliseconds(5));
+            ColorScheme color_scheme;
+            color_scheme.generate(image.get_dominant_colors(kmeans), image.is_light());
+            return color_scheme;
+        }, false);
+
+        return evaluator.run(std::cout) ? 0 : 1;
+    }
+#endif
+
+    struct RunOptions {
+        float max_extract_ms = -1.0f;
+        int transition_frames = 0;
+        float transition_fps = 30.0f;
+        int analysis_size = 256;
+        int threads = 0;
+    };
+
+    // Upper bounds for the integer flags: far beyond any useful setting, low enough that nothing sized from them
+    // (threads started, pixels analysed, frames written) can exhaust the machine.
+    constexpr int max_threads_argument = 1024;
+    constexpr int max_analysis_size = 8192;
+    constexpr int max_transition_frames = 10000;
+
+    // Consumes a flag shared by a normal run and --serve (and its value); returns false for any other flag.
+    bool parse_run_option(const std::string &flag, char *argv[], int &i, RunOptions &options) {
+        if (flag == "--transition-frames") {
+            options.transition_frames = parse_int_argument(flag, argv[++i], 0, max_transition_frames);
+        } else if (flag == "--analysis-size") {
+            options.analysis_size = parse_int_argument(flag, argv[++i], 1, max_analysis_size);
+        } else if (flag == "--threads") {
+            options.threads = parse_int_argument(flag, argv[++i], 0, max_threads_argument);
+        } else if (flag == "--max-extract-ms" || flag == "--transition-fps") {
+            float value = parse_float_argument(flag, argv[++i]);
+            if (value < 0.0f || (flag == "--transition-fps" && value == 0.0f)) {
+                throw std::runtime_error("Invalid value for " + flag + ": " + argv[i]);
+            }
+
+            if (flag == "--max-extract-ms") {
+                options.max_extract_ms = value;
+            } else {
+                options.transition_fps = value;
+            }
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // At the default analysis size and without a budget the default extraction is kept. Larger images go to the
+    // in-tree k-means on options.threads threads, and with a budget the reason it stopped is reported.
+    std::vector<Color> extract_colors(const Image &image, const RunOptions &options) {
+        bool budgeted = options.max_extract_ms >= 0.0f;
+        if (!budgeted && options.analysis_size <= 256) {
+            return image.get_dominant_colors();
+        }
+
+        KMeans kmeans(32, 10, 1.0f, 3);
+        kmeans.set_threads(options.threads);
+        if (!budgeted) {
+            return image.get_dominant_colors(kmeans);
+        }
+        kmeans.set_time_budget(std::chrono::microseconds((long long) (options.max_extract_ms * 1000.0f)));
+
+        auto start = std::chrono::steady_clock::now();
+        Image::Extraction extraction = image.extract_dominant_colors(kmeans);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        const char *reason = extraction.termination == KMeans::Termination::deadline ? "deadline"
+                           : extraction.termination == KMeans::Termination::converged ? "converged"
+                           : "iteration limit";
+        std::cerr << "Color extraction stopped by " << reason << " after " << extraction.iterations
+                  << " iterations (" << elapsed.count() << " ms)" << std::endl;
+
+        return extraction.colors;
+    }
+
+    struct Variant {
+        std::string suffix;
+        ColorScheme color_scheme;
+    };
+
+    // The last scheme written for every variant is kept here, so the next wallpaper change can fade from it.
+    std::string scheme_cache_path(const std::string &suffix) {
+        const char *cache_home = getenv("XDG_CACHE_HOME");
+        if (cache_home != nullptr && cache_home[0] != '\0') {
+            return std::string(cache_home) + "/huemaster/scheme" + suffix;
+        }
+        return std::string(getenv("HOME")) + "/.cache/huemaster/scheme" + suffix;
+    }
+
+    bool load_previous_scheme(const std::string &suffix, ColorScheme &color_scheme) {
+        std::ifstream file(scheme_cache_path(suffix));
+        if (!file.is_open()) {
+            return false;
+        }
+
+        std::stringstream dump;
+        dump << file.rdbuf();
+        try {
+            color_scheme = ColorScheme::from_dump(dump.str());
+        } catch (const std::runtime_error &e) {
+            std::cerr << "Ignoring previous color scheme: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void save_scheme(const std::string &suffix, const ColorScheme &color_scheme) {
+        std::string path = scheme_cache_path(suffix);
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+
+        std::string dump;
+        color_scheme.append_dump(dump);
+        Writer::write(path, dump);
+    }
+
+    void report_hooks(const std::vector<HookRunner::Outcome> &outcomes) {
+        for (const HookRunner::Outcome &outcome: outcomes) {
+            std::cerr << "Reload hook '" << outcome.name << "' ";
+            if (outcome.timed_out) {
+                std::cerr << "timed out after " << outcome.milliseconds << " ms";
+            } else if (outcome.exit_status != 0) {
+                std::cerr << "failed with status " << outcome.exit_status << " after " << outcome.milliseconds << " ms";
+            } else {
+                std::cerr << "finished in " << outcome.milliseconds << " ms";
+            }
+            std::cerr << std::endl;
+        }
+    }
+
+    // Fades every variant from its previous scheme to the new one over options.transition_frames frames, the last of
+    // which is the new scheme itself. Frames reuse the prefetched templates, so a frame costs a render and a write.
+    void run_transition(Configurator &configurator, const std::vector<Variant> &variants,
+                        const std::vector<ColorScheme> &previous, const RunOptions &options) {
+        typedef std::chrono::steady_clock Clock;
+        auto frame_interval = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / options.transition_fps));
+
+        Clock::time_point start = Clock::now();
+        double slowest_frame = 0.0;
+        for (int frame = 1; frame <= options.transition_frames; frame++) {
+            std::this_thread::sleep_until(start + frame_interval * (frame - 1));
+
+            Clock::time_point frame_start = Clock::now();
+            float amount = (float) frame / (float) options.transition_frames;
+            for (size_t i = 0; i < variants.size(); i++) {
+                if (frame == options.transition_frames) {
+                    configurator.configure(variants[i].color_scheme, variants[i].suffix);
+                } else {
+                    configurator.configure(ColorScheme::interpolate(previous[i], variants[i].color_scheme, amount),
+                                           variants[i].suffix);
+                }
+            }
+            Clock::time_point rendered = Clock::now();
+            std::vector<HookRunner::Outcome> outcomes = configurator.reload();
+            Clock::time_point reloaded = Clock::now();
+
+            std::chrono::duration<double, std::milli> render_time = rendered - frame_start;
+            std::chrono::duration<double, std::milli> reload_time = reloaded - rendered;
+            slowest_frame = std::max(slowest_frame, render_time.count() + reload_time.count());
+            std::cerr << "Transition frame " << frame << "/" << options.transition_frames << ": render and write "
+                      << render_time.count() << " ms, reload " << reload_time.count() << " ms" << std::endl;
+            for (const HookRunner::Outcome &outcome: outcomes) {
+                if (outcome.timed_out || outcome.exit_status != 0) {
+                    report_hooks({outcome});
+                }
+            }
+        }
+
+        std::chrono::duration<double, std::milli> total = Clock::now() - start;
+        std::chrono::duration<double, std::milli> target = frame_interval;
+        std::cerr << "Transition took " << total.count() << " ms; slowest frame " << slowest_frame << " ms of a "
+                  << target.count() << " ms frame interval" << std::endl;
+    }
+
+    void write_variants(Configurator &configurator, const std::vector<Variant> &variants, const RunOptions &options) {
+        std::vector<ColorScheme> previous(variants.size());
+        bool transition = options.transition_frames > 1;
+        for (size_t i = 0; i < variants.size() && transition; i++) {
+            transition = load_previous_scheme(variants[i].suffix, previous[i]);
+        }
+
+        if (transition) {
+            run_transition(configurator, variants, previous, options);
+        } else {
+            for (const Variant &variant: variants) {
+                configurator.configure(variant.color_scheme, variant.suffix);
+            }
+            report_hooks(configurator.reload());
+        }
+
+        for (const Variant &variant: variants) {
+            save_scheme(variant.suffix, variant.color_scheme);
+        }
+    }
+
+    // Runs the whole pipeline for one wallpaper and returns the scheme matching the wallpaper's own theme.
+    ColorScheme apply_wallpaper(Configurator &configurator, const std::string &wallpaper_path,
+                                const RunOptions &options) {
+        // template I/O runs alongside the image work, which is the critical path
+        std::future<void> prefetch = std::async(std::launch::async, [&configurator] {
+            configurator.prefetch();
+        });
+
+        Image image(wallpaper_path);
+        image.resize(options.analysis_size, options.analysis_size);
+
+        if (configurator.has_variants()) {
+            // extract once, then build both themes from the same palette
+            std::vector<Color> dominant_colors = extract_colors(image, options);
+            auto generate_variant = [&dominant_colors](bool light) {
+                ColorScheme color_scheme;
+                color_scheme.generate(dominant_colors, light);
+                return color_scheme;
+            };
+
+            std::future<ColorScheme> light_future = std::async(std::launch::async, generate_variant, true);
+            ColorScheme dark_scheme = generate_variant(false);
+            ColorScheme light_scheme = light_future.get();
+
+            prefetch.get();
+            write_variants(configurator, {{configurator.get_light_suffix(), light_scheme},
+                                          {configurator.get_dark_suffix(), dark_scheme}}, options);
+
+            return image.is_light() ? light_scheme : dark_scheme;
+        }
+
+        ColorScheme color_scheme;
+        color_scheme.generate(extract_colors(image, options), image.is_light());
+
+        prefetch.get();
+        write_variants(configurator, {{"", color_scheme}}, options);
+
+        return color_scheme;
+    }
+
+    Configurator load_configurator() {
         Configurator configurator;
         std::string config_path = std::string(getenv("HOME")) + "/.config/huemaster/config.toml";
         configurator.load_config(config_path);
-        std::string wallpaper_path = configurator.get_wallpaper_path();
+        return configurator;
+    }
 
-        Image image(wallpaper_path);
-        image.resize(256, 256);
+    int run_server(int argc, char *argv[]) {
+        std::string socket_path = PaletteServer::default_socket_path();
+        RunOptions options;
+        for (int i = 2; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--socket" && i + 1 < argc) {
+                socket_path = argv[++i];
+            } else if (!parse_run_option(flag, argv, i, options)) {
+                throw std::runtime_error("Unknown argument: " + flag);
+            }
+        }
 
-        ColorScheme color_scheme;
-        color_scheme.generate(image);
+        Configurator configurator = load_configurator();
+        ColorScheme color_scheme = apply_wallpaper(configurator, configurator.get_wallpaper_path(), options);
 
-        configurator.configure(color_scheme);
-    } catch (const std::runtime_error &e) {
-        std::cerr << e.what() << std::endl;
-        return 1;
+        PaletteServer server(socket_path, color_scheme, [&configurator, options](const std::string &wallpaper_path) {
+            return apply_wallpaper(configurator, wallpaper_path, options);
+        });
+        server.run();
+        return 0;
+    }
+
+    int run_query(int argc, char *argv[]) {
+        std::string socket_path = PaletteServer::default_socket_path();
+        std::vector<std::string> requests;
+        for (int i = 2; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument == "--socket" && i + 1 < argc) {
+                socket_path = argv[++i];
+            } else {
+                requests.push_back(argument);
+            }
+        }
+
+        PaletteClient client(socket_path);
+        int status = 0;
+        for (const PaletteClient::Response &response: client.query(requests)) {
+            if (response.success) {
+                std::cout << response.payload;
+                if (response.payload.empty() || response.payload.back() != '\n') {
+                    std::cout << '\n';
+                }
+            } else {
+                std::cerr << response.payload << '\n';
+                status = 1;
+            }
+        }
+        std::cout << std::flush;
+        return status;
+    }
+
+    int run_index(int argc, char *argv[]) {
+        std::string index_path = PaletteIndex::default_index_path();
+        std::string directory;
+        for (int i = 2; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument == "--index-file" && i + 1 < argc) {
+                index_path = argv[++i];
+            } else if (directory.empty()) {
+                directory = argument;
+            } else {
+                throw std::runtime_error("Unknown argument: " + argument);
+            }
+        }
+        if (directory.empty()) {
+            throw std::runtime_error("Missing wallpaper directory for --index");
+        }
+
+        PaletteIndex index(index_path);
+        index.update(directory, std::cerr);
+        return 0;
+    }
+
+    int run_find(int argc, char *argv[]) {
+        std::string index_path = PaletteIndex::default_index_path();
+        std::string like_path;
+        PaletteIndex::Query query;
+        size_t count = 10;
+        for (int i = 2; i < argc; i++) {
+            std::string flag = argv[i];
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + flag);
+            }
+
+            std::string value = argv[++i];
+            if (flag == "--index-file") {
+                index_path = value;
+            } else if (flag == "--palette") {
+                query.palette = PaletteIndex::parse_palette(value);
+            } else if (flag == "--like") {
+                like_path = value;
+            } else if (flag == "--background" && (value == "dark" || value == "light")) {
+                query.background = value == "light" ? 1 : 0;
+            } else if (flag == "--accent" && (value == "cool" || value == "warm")) {
+                query.accent = value == "warm" ? 1 : 0;
+            } else if (flag == "--count") {
+                count = parse_count_argument(flag, value.c_str());
+            } else {
+                throw std::runtime_error("Unknown argument: " + flag + " " + value);
+            }
+        }
+
+        PaletteIndex index(index_path);
+        if (!like_path.empty() && !index.lookup(like_path, query.palette)) {
+            query.palette = PaletteIndex::image_palette(like_path);
+        }
+
+        std::string output;
+        for (const PaletteIndex::Match &match: index.find(query, count)) {
+            output += std::to_string(match.distance);
+            output += '\t';
+            output += match.path;
+            output += '\n';
+        }
+        std::cout << output << std::flush;
+        return 0;
     }
 
-    return 0;
+    // Times the in-tree k-means on the image scaled to 4K for 1 to max_threads threads and checks that every thread
+    // count gives the single-threaded palette.
+    int run_kmeans_scaling(int argc, char *argv[]) {
+        std::string image_path;
+        int max_threads = (int) std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 2; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument == "--max-threads") {
+                max_threads = parse_int_argument(argument, argv[++i], 1, max_threads_argument);
+            } else if (image_path.empty()) {
+                image_path = argument;
+            } else {
+                throw std::runtime_error("Unknown argument: " + argument);
+            }
+        }
+        if (image_path.empty()) {
+            throw std::runtime_error("Missing image for --kmeans-scaling");
+        }
+
+        Image image(image_path);
+        image.resize(3840, 2160);
+
+        std::vector<Color> reference;
+        double single_thread_ms = 0.0;
+        bool identical = true;
+        std::cout << "threads\tms\tspeedup\tpalette" << std::endl;
+        for (int threads = 1; threads <= max_threads; threads++) {
+            KMeans kmeans(32, 10, 1.0f, 3);
+            kmeans.set_threads(threads);
+
+            // best of three, so a stray scheduling hiccup does not skew the curve
+            double best_ms = std::numeric_limits<double>::max();
+            std::vector<Color> colors;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::steady_clock::now();
+                colors = image.get_dominant_colors(kmeans);
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                best_ms = std::min(best_ms, elapsed.count());
+            }
+
+            bool same = true;
+            if (threads == 1) {
+                reference = colors;
+                single_thread_ms = best_ms;
+            } else {
+                same = colors.size() == reference.size();
+                for (size_t c = 0; same && c < colors.size(); c++) {
+                    Vec3f color = colors[c].get_color(), reference_color = reference[c].get_color();
+                    same = std::equal(color.val, color.val + 3, reference_color.val)
+                           && colors[c].get_proportion() == reference[c].get_proportion();
+                }
+                identical &= same;
+            }
+
+            std::cout << threads << '\t' << best_ms << '\t' << single_thread_ms / best_ms << '\t'
+                      << (same ? "identical" : "DIFFERENT") << std::endl;
+        }
+
+        return identical ? 0 : 1;
+    }
 }
 
+int main(int argc, char *argv[]) {
+    try {
+        std::string mode = argc > 1 ? argv[1] : "";
+#ifndef HUEMASTER_LITE_IMAGE
+        if (mode == "--evaluate") {
+            return run_evaluation(argc, argv);
+        }
+#endif
+        if (mode == "--serve") {
+            return run_server(argc, argv);
+        } else if (mode == "--query") {
+            return run_query(argc, argv);
+        } else if (mode == "--index") {
+            return run_index(argc, argv);
+        } else if (mode == "--find") {
+            return run_find(argc, argv);
+        } else if (mode == "--kmeans-scaling") {
+            return run_kmeans_scaling(argc, argv);
+        } else if (mode == "--self-check") {
+            if (argc > 2) {
+                throw std::runtime_error(std::string("Unknown argument: ") + argv[2]);
+            }
+            return SelfCheck::run(std::cout) ? 0 : 1;
+        }
+
+        RunOptions options;
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (!parse_run_option(flag, argv, i, options)) {
+                throw std::runtime_error("Unknown argument: " + flag);
+            }
+        }
+
+        Configurator configurator = load_configurator();
+        apply_wallpaper(configurator, configurator.get_wallpaper_path(), options);
+        return 0;
+    } catch (const std::exception &e) { // std::bad_alloc from a huge image as much as a bad argument
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
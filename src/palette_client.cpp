@@ -0,0 +1,103 @@
+#include "palette_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+PaletteClient::PaletteClient(const std::string &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + socket_path);
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr *) &address, sizeof(address)) < 0) {
+        std::string error = std::strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Failed to connect to palette server: " + socket_path + " (" + error + ")");
+    }
+}
+
+PaletteClient::~PaletteClient() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+std::vector<PaletteClient::Response> PaletteClient::query(const std::vector<std::string> &requests) {
+    std::string output;
+    for (const std::string &request: requests) {
+        if (request.find('\n') != std::string::npos) {
+            throw std::runtime_error("Requests must not contain newlines");
+        }
+        output += request;
+        output += '\n';
+    }
+
+    size_t written = 0;
+    while (written < output.size()) {
+        ssize_t sent = send(fd, output.data() + written, output.size() - written, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0) {
+            throw std::runtime_error("Failed to send request: " + std::string(std::strerror(errno)));
+        }
+        written += sent;
+    }
+
+    std::vector<Response> responses;
+    for (size_t i = 0; i < requests.size(); i++) {
+        responses.push_back(read_response());
+    }
+    return responses;
+}
+
+PaletteClient::Response PaletteClient::read_response() {
+    size_t header_end;
+    while ((header_end = buffer.find('\n')) == std::string::npos) {
+        fill_buffer();
+    }
+
+    std::string header = buffer.substr(0, header_end);
+    size_t separator = header.find(' ');
+    std::string status = header.substr(0, separator);
+    if (separator == std::string::npos || (status != "OK" && status != "ERR")) {
+        throw std::runtime_error("Malformed response from palette server: " + header);
+    }
+
+    size_t length;
+    try {
+        length = std::stoul(header.substr(separator + 1));
+    } catch (const std::logic_error &e) {
+        throw std::runtime_error("Malformed response from palette server: " + header);
+    }
+
+    while (buffer.size() < header_end + 1 + length) {
+        fill_buffer();
+    }
+
+    Response response{status == "OK", buffer.substr(header_end + 1, length)};
+    buffer.erase(0, header_end + 1 + length);
+    return response;
+}
+
+void PaletteClient::fill_buffer() {
+    char chunk[4096];
+    ssize_t received;
+    do {
+        received = recv(fd, chunk, sizeof(chunk), 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0) {
+        throw std::runtime_error("Palette server closed the connection");
+    }
+    buffer.append(chunk, received);
+}
@@ -0,0 +1,424 @@
+#include "palette_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "color_scheme.h"
+
+namespace {
+    const char index_magic[8] = {'H', 'M', 'P', 'A', 'L', 'I', 'D', 'X'};
+    const float degrees_per_radian = 57.2957795f;
+
+    bool is_image_file(const std::filesystem::path &path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+            return (char) std::tolower(c);
+        });
+        return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".webp";
+    }
+
+    float lab_distance(const float *a, const Vec3f &b) {
+        float d0 = a[0] - b[0], d1 = a[1] - b[1], d2 = a[2] - b[2];
+        return std::sqrt(d0 * d0 + d1 * d1 + d2 * d2);
+    }
+
+    struct ScannedFile {
+        std::string path;
+        int64_t modified;
+        uint64_t file_size;
+    };
+}
+
+PaletteIndex::PaletteIndex(std::string index_path) : index_path(std::move(index_path)) {
+    map();
+}
+
+PaletteIndex::~PaletteIndex() {
+    unmap();
+}
+
+void PaletteIndex::update(const std::string &directory, std::ostream &log) {
+    if (!std::filesystem::is_directory(directory)) {
+        throw std::runtime_error("Not a directory: '" + directory + "'");
+    }
+
+    std::unordered_map<std::string, const Entry *> existing;
+    if (header != nullptr) {
+        for (uint32_t i = 0; i < header->entry_count; i++) {
+            existing[entry_path(entries[i])] = &entries[i];
+        }
+    }
+
+    std::vector<ScannedFile> files;
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (const auto &item: std::filesystem::recursive_directory_iterator(directory, options)) {
+        std::error_code error;
+        if (!item.is_regular_file(error) || !is_image_file(item.path())) {
+            continue;
+        }
+
+        std::string path = std::filesystem::absolute(item.path()).lexically_normal().string();
+        int64_t modified = item.last_write_time(error).time_since_epoch().count();
+        uint64_t file_size = item.file_size(error);
+        if (!error) {
+            files.push_back({path, modified, file_size});
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const ScannedFile &a, const ScannedFile &b) {
+        return a.path < b.path;
+    });
+
+    // unchanged files keep their entry, everything else is analyzed on all cores
+    std::vector<Entry> new_entries(files.size());
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < files.size(); i++) {
+        auto previous = existing.find(files[i].path);
+        if (previous != existing.end() && previous->second->modified == files[i].modified
+            && previous->second->file_size == files[i].file_size) {
+            new_entries[i] = *previous->second;
+        } else {
+            changed.push_back(i);
+        }
+        if (previous != existing.end()) {
+            existing.erase(previous);
+        }
+    }
+
+    std::atomic<size_t> next{0};
+    std::mutex log_mutex;
+    auto worker = [&]() {
+        for (size_t job = next++; job < changed.size(); job = next++) {
+            size_t i = changed[job];
+            try {
+                new_entries[i] = build_entry(files[i].path);
+            } catch (const std::exception &e) {
+                // kept without a palette, so unreadable files are not retried until they change
+                new_entries[i] = Entry{};
+                std::lock_guard<std::mutex> lock(log_mutex);
+                log << "Skipping " << files[i].path << ": " << e.what() << std::endl;
+            }
+            new_entries[i].modified = files[i].modified;
+            new_entries[i].file_size = files[i].file_size;
+        }
+    };
+
+    unsigned int thread_count = std::max(1u, std::min<unsigned int>(std::thread::hardware_concurrency(),
+                                                                       (unsigned int) changed.size()));
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < thread_count; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+
+    // entries the scan did not see are only dropped if they lie below the scanned directory and their file is gone,
+    // so indexing one directory leaves the images of every other one alone
+    std::string root = std::filesystem::absolute(directory).lexically_normal().string();
+    while (!root.empty() && root.back() == '/') {
+        root.pop_back();
+    }
+    root += '/';
+
+    std::vector<std::pair<std::string, Entry>> indexed;
+    for (size_t i = 0; i < files.size(); i++) {
+        indexed.emplace_back(files[i].path, new_entries[i]);
+    }
+    size_t removed = 0;
+    for (const auto &previous: existing) {
+        std::error_code error;
+        if (previous.first.compare(0, root.size(), root) == 0 && !std::filesystem::exists(previous.first, error)
+            && !error) {
+            removed++;
+        } else {
+            indexed.emplace_back(previous.first, *previous.second);
+        }
+    }
+    std::sort(indexed.begin(), indexed.end(), [](const auto &a, const auto &b) {
+        return a.first < b.first;
+    });
+
+    std::string strings;
+    std::vector<Entry> output_entries;
+    for (const auto &item: indexed) {
+        Entry entry = item.second;
+        entry.path_offset = strings.size();
+        entry.path_length = (uint32_t) item.first.size();
+        strings += item.first;
+        output_entries.push_back(entry);
+    }
+
+    Header new_header{};
+    std::memcpy(new_header.magic, index_magic, sizeof(index_magic));
+    new_header.version = version;
+    new_header.entry_count = (uint32_t) output_entries.size();
+    new_header.entry_size = sizeof(Entry);
+    new_header.strings_offset = sizeof(Header) + output_entries.size() * sizeof(Entry);
+
+    std::filesystem::path parent = std::filesystem::path(index_path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent);
+    }
+
+    // write next to the old index and swap it in, so readers never see a partial file
+    std::string temporary_path = index_path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file: " + temporary_path);
+        }
+        file.write(reinterpret_cast<const char *>(&new_header), sizeof(Header));
+        file.write(reinterpret_cast<const char *>(output_entries.data()),
+                   (std::streamsize) (output_entries.size() * sizeof(Entry)));
+        file.write(strings.data(), (std::streamsize) strings.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write file: " + temporary_path);
+        }
+    }
+
+    unmap();
+    std::filesystem::rename(temporary_path, index_path);
+    map();
+
+    log << output_entries.size() << " images indexed, " << changed.size() << " analyzed, "
+        << removed << " removed" << std::endl;
+}
+
+std::vector<PaletteIndex::Match> PaletteIndex::find(const Query &query, size_t count) const {
+    if (header == nullptr) {
+        throw std::runtime_error("Palette index is missing or outdated, rebuild it with --index: " + index_path);
+    }
+
+    std::vector<std::pair<float, uint32_t>> ranked;
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        const Entry &entry = entries[i];
+        if (entry.palette_count == 0 || !matches_filters(entry, query)) {
+            continue;
+        }
+
+        float distance = query.palette.empty() ? 0.0f : palette_distance(query.palette, entry);
+        ranked.emplace_back(distance, i);
+    }
+
+    size_t kept = std::min(count, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + (long) kept, ranked.end());
+
+    std::vector<Match> matches;
+    for (size_t i = 0; i < kept; i++) {
+        matches.push_back({entry_path(entries[ranked[i].second]), ranked[i].first});
+    }
+    return matches;
+}
+
+bool PaletteIndex::lookup(const std::string &image_path, std::vector<PaletteColor> &palette) const {
+    if (header == nullptr) {
+        return false;
+    }
+
+    std::string path = std::filesystem::absolute(image_path).lexically_normal().string();
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        if (entries[i].palette_count == 0 || entry_path(entries[i]) != path) {
+            continue;
+        }
+
+        palette.clear();
+        for (uint32_t c = 0; c < entries[i].palette_count; c++) {
+            const float *color = entries[i].palette[c];
+            palette.push_back({{color[0], color[1], color[2]}, color[3]});
+        }
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<PaletteIndex::PaletteColor> PaletteIndex::image_palette(const std::string &image_path) {
+    Entry entry = build_entry(image_path);
+    std::vector<PaletteColor> palette;
+    for (uint32_t c = 0; c < entry.palette_count; c++) {
+        palette.push_back({{entry.palette[c][0], entry.palette[c][1], entry.palette[c][2]}, entry.palette[c][3]});
+    }
+    return palette;
+}
+
+std::vector<PaletteIndex::PaletteColor> PaletteIndex::parse_palette(const std::string &hex_colors) {
+    std::vector<PaletteColor> palette;
+    size_t start = 0;
+    while (start <= hex_colors.size()) {
+        size_t end = hex_colors.find(',', start);
+        if (end == std::string::npos) {
+            end = hex_colors.size();
+        }
+
+        palette.push_back({Color::from_hex(hex_colors.substr(start, end - start)).get_lab(), 1.0f});
+        start = end + 1;
+    }
+    return palette;
+}
+
+std::string PaletteIndex::default_index_path() {
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home != nullptr && cache_home[0] != '\0') {
+        return std::string(cache_home) + "/huemaster/palette.index";
+    }
+    return std::string(getenv("HOME")) + "/.cache/huemaster/palette.index";
+}
+
+void PaletteIndex::map() {
+    int fd = open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) < 0 || (size_t) file_stat.st_size < sizeof(Header)) {
+        close(fd);
+        return;
+    }
+
+    size = (size_t) file_stat.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        size = 0;
+        return;
+    }
+    data = static_cast<const unsigned char *>(mapping);
+
+    // an index from another version is ignored and rebuilt from scratch
+    const auto *mapped_header = reinterpret_cast<const Header *>(data);
+    bool valid = std::memcmp(mapped_header->magic, index_magic, sizeof(index_magic)) == 0
+                 && mapped_header->version == version
+                 && mapped_header->entry_size == sizeof(Entry)
+                 && mapped_header->strings_offset == sizeof(Header) + (uint64_t) mapped_header->entry_count
+                                                                      * sizeof(Entry)
+                 && mapped_header->strings_offset <= size;
+    if (valid) {
+        const auto *mapped_entries = reinterpret_cast<const Entry *>(data + sizeof(Header));
+        uint64_t strings_size = size - mapped_header->strings_offset;
+        for (uint32_t i = 0; i < mapped_header->entry_count && valid; i++) {
+            // compared without adding, so a corrupt offset cannot wrap around and pass
+            valid = mapped_entries[i].path_offset <= strings_size
+                    && mapped_entries[i].path_length <= strings_size - mapped_entries[i].path_offset
+                    && mapped_entries[i].palette_count <= (uint32_t) palette_size;
+        }
+    }
+    if (!valid) {
+        unmap();
+        return;
+    }
+
+    header = mapped_header;
+    entries = reinterpret_cast<const Entry *>(data + sizeof(Header));
+}
+
+void PaletteIndex::unmap() {
+    if (data != nullptr) {
+        munmap(const_cast<unsigned char *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+    entries = nullptr;
+}
+
+std::string PaletteIndex::entry_path(const Entry &entry) const {
+    const char *strings = reinterpret_cast<const char *>(data + header->strings_offset);
+    return {strings + entry.path_offset, entry.path_length};
+}
+
+PaletteIndex::Entry PaletteIndex::build_entry(const std::string &image_path) {
+    Image image(image_path);
+    image.resize(256, 256);
+
+    std::vector<Color> dominant_colors = image.get_dominant_colors();
+    ColorScheme color_scheme;
+    color_scheme.generate(dominant_colors, image.is_light());
+
+    Entry entry{};
+    entry.light = color_scheme.is_light() ? 1 : 0;
+    entry.palette_count = (uint32_t) std::min<size_t>(dominant_colors.size(), palette_size);
+    for (uint32_t c = 0; c < entry.palette_count; c++) {
+        Vec3f lab = dominant_colors[c].get_lab();
+        entry.palette[c][0] = lab[0];
+        entry.palette[c][1] = lab[1];
+        entry.palette[c][2] = lab[2];
+        entry.palette[c][3] = dominant_colors[c].get_proportion();
+    }
+
+    const std::vector<std::string> &slot_names = ColorScheme::get_slot_names();
+    if (slot_names.size() != slot_count) {
+        throw std::runtime_error("Palette index slot layout does not match the color scheme");
+    }
+    for (int slot = 0; slot < slot_count; slot++) {
+        Vec3f lab = color_scheme.name_to_color(slot_names[slot]).result.get_lab();
+        entry.slots[slot][0] = lab[0];
+        entry.slots[slot][1] = lab[1];
+        entry.slots[slot][2] = lab[2];
+    }
+
+    return entry;
+}
+
+bool PaletteIndex::matches_filters(const Entry &entry, const Query &query) {
+    if (query.background >= 0 && (int) entry.light != query.background) {
+        return false;
+    }
+
+    if (query.accent >= 0) {
+        const std::vector<std::string> &slot_names = ColorScheme::get_slot_names();
+        long accent_slot = std::find(slot_names.begin(), slot_names.end(), "ACCENT") - slot_names.begin();
+        const float *accent = entry.slots[accent_slot];
+        float hue = std::atan2(accent[2], accent[1]) * degrees_per_radian;
+        bool warm = hue >= -45.0f && hue <= 100.0f; // reds, oranges and yellows
+        if ((int) warm != query.accent) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+float PaletteIndex::palette_distance(const std::vector<PaletteColor> &query, const Entry &entry) {
+    if (entry.palette_count == 0) {
+        return 1e9f;
+    }
+
+    // average of the weighted nearest-color distances in both directions
+    float query_total = 0.0f, query_weight = 0.0f;
+    for (const PaletteColor &color: query) {
+        float nearest = 1e9f;
+        for (uint32_t c = 0; c < entry.palette_count; c++) {
+            nearest = std::min(nearest, lab_distance(entry.palette[c], color.lab));
+        }
+        query_total += color.weight * nearest;
+        query_weight += color.weight;
+    }
+
+    float entry_total = 0.0f, entry_weight = 0.0f;
+    for (uint32_t c = 0; c < entry.palette_count; c++) {
+        float nearest = 1e9f;
+        for (const PaletteColor &color: query) {
+            nearest = std::min(nearest, lab_distance(entry.palette[c], color.lab));
+        }
+        entry_total += entry.palette[c][3] * nearest;
+        entry_weight += entry.palette[c][3];
+    }
+
+    float forward = query_weight > 0.0f ? query_total / query_weight : 0.0f;
+    float backward = entry_weight > 0.0f ? entry_total / entry_weight : 0.0f;
+    return 0.5f * (forward + backward);
+}
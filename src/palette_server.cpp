@@ -0,0 +1,352 @@
+#include "palette_server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    const size_t max_pending_input = 1 << 20;
+
+    volatile std::sig_atomic_t stop_requested = 0;
+
+    void request_stop(int) {
+        stop_requested = 1;
+    }
+
+    void append_response(std::string &output, bool success, const std::string &payload) {
+        output += success ? "OK " : "ERR ";
+        output += std::to_string(payload.size());
+        output += '\n';
+        output += payload;
+    }
+}
+
+PaletteServer::PaletteServer(std::string socket_path, ColorScheme color_scheme, WallpaperHandler wallpaper_handler)
+        : socket_path(std::move(socket_path)), color_scheme(std::move(color_scheme)),
+          wallpaper_handler(std::move(wallpaper_handler)) { }
+
+PaletteServer::~PaletteServer() {
+    // the worker reports through the pipe and reads the handler, so it has to finish first
+    if (wallpaper_job.valid()) {
+        wallpaper_job.wait();
+    }
+    for (int fd: wallpaper_pipe) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    for (const auto &connection: connections) {
+        close(connection.first);
+    }
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+}
+
+void PaletteServer::run() {
+    open_socket();
+    if (pipe2(wallpaper_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw std::runtime_error("Failed to create pipe for wallpaper switches: " + std::string(std::strerror(errno)));
+    }
+
+    struct sigaction action{};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::vector<pollfd> poll_fds;
+    while (!stop_requested) {
+        poll_fds.clear();
+        poll_fds.push_back({listen_fd, POLLIN, 0});
+        poll_fds.push_back({wallpaper_pipe[0], POLLIN, 0});
+        for (const auto &connection: connections) {
+            // a hung-up client waiting on a wallpaper switch would only report POLLHUP over and over
+            if (connection.second.closing && connection.second.output.empty()) {
+                continue;
+            }
+            short events = connection.second.closing ? 0 : POLLIN;
+            if (!connection.second.output.empty()) {
+                events |= POLLOUT;
+            }
+            poll_fds.push_back({connection.first, events, 0});
+        }
+
+        if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Failed to poll palette server socket: " + std::string(std::strerror(errno)));
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            accept_connections();
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            finish_wallpaper();
+        }
+
+        for (size_t i = 2; i < poll_fds.size(); i++) {
+            int fd = poll_fds[i].fd;
+            auto connection = connections.find(fd);
+            if (connection == connections.end()) {
+                continue;
+            }
+
+            bool healthy = true;
+            if (poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                healthy = read_requests(fd, connection->second);
+            }
+            if (healthy && !connection->second.output.empty()) {
+                healthy = write_responses(fd, connection->second);
+            }
+
+            const Connection &state = connection->second;
+            if (!healthy || (state.closing && !state.awaiting_wallpaper && state.output.empty())) {
+                close(fd);
+                connections.erase(connection);
+            }
+        }
+    }
+}
+
+std::string PaletteServer::default_socket_path() {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir != nullptr && runtime_dir[0] != '\0') {
+        return std::string(runtime_dir) + "/huemaster.sock";
+    }
+    return "/tmp/huemaster-" + std::to_string(getuid()) + ".sock";
+}
+
+void PaletteServer::open_socket() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + socket_path);
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    // refuse to take over a live server's socket, but clean up one left behind by a crash
+    if (std::filesystem::is_socket(socket_path)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, (sockaddr *) &address, sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (live) {
+            throw std::runtime_error("A palette server is already listening on: " + socket_path);
+        }
+        unlink(socket_path.c_str());
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error("Failed to create socket: " + std::string(std::strerror(errno)));
+    }
+
+    if (bind(listen_fd, (sockaddr *) &address, sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+        std::string error = std::strerror(errno);
+        close(listen_fd);
+        listen_fd = -1;
+        throw std::runtime_error("Failed to listen on socket: " + socket_path + " (" + error + ")");
+    }
+}
+
+void PaletteServer::accept_connections() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        connections[fd] = {};
+        connections[fd].id = next_connection_id++;
+    }
+}
+
+bool PaletteServer::read_requests(int fd, Connection &connection) {
+    char buffer[4096];
+    while (true) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            connection.input.append(buffer, received);
+        } else if (received == 0) {
+            connection.closing = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    process_input(connection);
+    return connection.input.size() <= max_pending_input;
+}
+
+void PaletteServer::process_input(Connection &connection) {
+    // answer every complete line; a partial request waits for the rest of its bytes, and everything after a
+    // WALLPAPER request waits for its response so responses stay in order
+    std::string request;
+    size_t start = 0;
+    size_t end;
+    while (!connection.awaiting_wallpaper && (end = connection.input.find('\n', start)) != std::string::npos) {
+        request.assign(connection.input, start, end - start);
+        if (!request.empty() && request.back() == '\r') {
+            request.pop_back();
+        }
+        handle_request(request, connection);
+        start = end + 1;
+    }
+    connection.input.erase(0, start);
+}
+
+bool PaletteServer::write_responses(int fd, Connection &connection) {
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        ssize_t sent = send(fd, connection.output.data() + written, connection.output.size() - written,
+                            MSG_NOSIGNAL);
+        if (sent > 0) {
+            written += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    connection.output.erase(0, written);
+    return true;
+}
+
+void PaletteServer::handle_request(const std::string &request, Connection &connection) {
+    size_t separator = request.find(' ');
+    std::string command = request.substr(0, separator);
+    std::string argument = separator == std::string::npos ? "" : request.substr(separator + 1);
+
+    std::string payload;
+    try {
+        if (command == "EVAL") {
+            handle_eval(argument, payload);
+        } else if (command == "DUMP") {
+            handle_dump(payload);
+        } else if (command == "RENDER") {
+            handle_render(argument, payload);
+        } else if (command == "WALLPAPER") {
+            queue_wallpaper(argument, connection);
+            return; // answered by finish_wallpaper()
+        } else {
+            throw std::runtime_error("Unknown request: `" + command + "`");
+        }
+    } catch (const std::exception &e) {
+        append_response(connection.output, false, e.what());
+        return;
+    }
+
+    append_response(connection.output, true, payload);
+}
+
+void PaletteServer::handle_eval(const std::string &argument, std::string &payload) const {
+    ColorScheme::ConversionResult result = color_scheme.commands_to_color(argument);
+    if (!result.success) {
+        throw std::runtime_error("Failed to parse color: `" + argument + "`");
+    }
+    result.result.append_to(payload);
+}
+
+void PaletteServer::handle_dump(std::string &payload) const {
+    color_scheme.append_dump(payload);
+}
+
+void PaletteServer::handle_render(const std::string &argument, std::string &payload) {
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(argument, error);
+    if (error) {
+        throw std::runtime_error("Failed to open file: " + argument);
+    }
+
+    auto cached = templates.find(argument);
+    if (cached == templates.end() || cached->second.modified != modified) {
+        cached = templates.insert_or_assign(argument, CachedTemplate{modified, Parser::scan(argument)}).first;
+    }
+
+    Parser::render(cached->second.format_template, color_scheme, payload);
+}
+
+void PaletteServer::queue_wallpaper(const std::string &argument, Connection &connection) {
+    if (argument.empty()) {
+        throw std::runtime_error("Missing wallpaper path");
+    }
+
+    wallpaper_requests.push_back({connection.id, argument});
+    connection.awaiting_wallpaper = true;
+    if (!wallpaper_job.valid()) {
+        start_wallpaper();
+    }
+}
+
+void PaletteServer::start_wallpaper() {
+    if (wallpaper_requests.empty()) {
+        return;
+    }
+
+    wallpaper_job = std::async(std::launch::async, [this, path = wallpaper_requests.front().path] {
+        // signals the poll loop however the handler leaves; get() then waits out the last moments of the worker
+        struct Notifier {
+            int fd;
+            ~Notifier() {
+                char byte = 0;
+                ssize_t ignored = write(fd, &byte, 1);
+                (void) ignored;
+            }
+        } notifier{wallpaper_pipe[1]};
+        return wallpaper_handler(path);
+    });
+}
+
+void PaletteServer::finish_wallpaper() {
+    char buffer[64];
+    while (read(wallpaper_pipe[0], buffer, sizeof(buffer)) > 0) { }
+    if (!wallpaper_job.valid()) {
+        return;
+    }
+
+    WallpaperRequest finished = std::move(wallpaper_requests.front());
+    wallpaper_requests.pop_front();
+
+    bool success = true;
+    std::string payload;
+    try {
+        color_scheme = wallpaper_job.get();
+        payload = finished.path;
+    } catch (const std::exception &e) {
+        success = false;
+        payload = e.what();
+    }
+
+    // the requesting connection may have gone away in the meantime
+    for (auto &connection: connections) {
+        if (connection.second.id == finished.connection_id) {
+            append_response(connection.second.output, success, payload);
+            connection.second.awaiting_wallpaper = false;
+            process_input(connection.second);
+            break;
+        }
+    }
+
+    // the connection's remaining requests may already have started the next switch
+    if (!wallpaper_job.valid()) {
+        start_wallpaper();
+    }
+}
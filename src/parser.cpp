@@ -1,7 +1,16 @@
 #include "parser.h"
 
+#include <sstream>
+
 std::string Parser::parse(const std::string &format_path, const ColorScheme &color_scheme) {
     std::string parsed_config;
+    render(scan(format_path), color_scheme, parsed_config);
+    return parsed_config;
+}
+
+FormatTemplate Parser::scan(const std::string &format_path) {
+    FormatTemplate format_template;
+    format_template.format_path = format_path;
 
     std::ifstream file(format_path);
     if (!file.is_open()) {
@@ -11,52 +20,68 @@ std::string Parser::parse(const std::string &format_path, const ColorScheme &col
     std::string line;
     int line_number = 1;
     while (std::getline(file, line)) {
-        std::string parsed_line = Parser::parse_line(format_path, color_scheme, line, line_number);
-        parsed_config += parsed_line + '\n';
+        line += '\n';
+        Parser::scan_line(line, line_number, format_template);
         line_number++;
     }
 
     file.close();
 
-    return parsed_config;
+    return format_template;
 }
 
-std::string Parser::parse_line(const std::string &format_path, const ColorScheme &color_scheme, const std::string &line,
-                               int line_number) {
-    std::string parsed_line;
-    std::string current_segment;
-    bool placeholder = false;
-    for (size_t i = 0; i < line.size(); i++) {
-        if (line[i] == '$' && i + 1 < line.size() && line[i + 1] == '$') {
-            if (placeholder) {
-                parsed_line += parse_placeholder(format_path, color_scheme, current_segment, line_number);
-            } else {
-                parsed_line += current_segment;
-            }
-            placeholder = !placeholder;
-            current_segment.clear();
-            i++;
-        } else {
-            current_segment += line[i];
+void Parser::scan_line(const std::string &line, int line_number, FormatTemplate &format_template) {
+    auto append_literal = [&format_template, line_number](const std::string &text, size_t start, size_t length) {
+        if (length == 0) {
+            return;
         }
-    }
 
-    if (placeholder) {
-        std::stringstream error_message;
-        error_message << "Placeholder missing closing '$$' in file: `" << format_path << "` at line: "
-                      << line_number;
-        throw std::runtime_error(error_message.str());
-    }
+        std::vector<FormatTemplate::Segment> &segments = format_template.segments;
+        if (segments.empty() || segments.back().placeholder) {
+            segments.push_back({"", false, line_number});
+        }
+        segments.back().text.append(text, start, length);
+        format_template.literal_size += length;
+    };
 
-    parsed_line += current_segment;
+    size_t position = 0;
+    while (true) {
+        size_t start = line.find("$$", position);
+        if (start == std::string::npos) {
+            append_literal(line, position, line.size() - position);
+            return;
+        }
+        append_literal(line, position, start - position);
+
+        size_t end = line.find("$$", start + 2);
+        if (end == std::string::npos) {
+            std::stringstream error_message;
+            error_message << "Placeholder missing closing '$$' in file: `" << format_template.format_path
+                          << "` at line: " << line_number;
+            throw std::runtime_error(error_message.str());
+        }
 
-    return parsed_line;
+        format_template.segments.push_back({line.substr(start + 2, end - start - 2), true, line_number});
+        position = end + 2;
+    }
 }
 
-std::string Parser::parse_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
-                                      const std::string &placeholder, int line_number) {
-    if (placeholder.size() >= 5 && placeholder.substr(0, 5) == "LIGHT") {
-        return parse_ternary_placeholder(format_path, color_scheme, placeholder, line_number);
+void Parser::render(const FormatTemplate &format_template, const ColorScheme &color_scheme, std::string &output) {
+    output.reserve(output.size() + format_template.literal_size);
+    for (const FormatTemplate::Segment &segment: format_template.segments) {
+        if (segment.placeholder) {
+            parse_placeholder(format_template.format_path, color_scheme, segment.text, segment.line_number, output);
+        } else {
+            output += segment.text;
+        }
+    }
+}
+
+void Parser::parse_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
+                               const std::string &placeholder, int line_number, std::string &output) {
+    if (placeholder.size() >= 5 && placeholder.compare(0, 5, "LIGHT") == 0) {
+        parse_ternary_placeholder(format_path, color_scheme, placeholder, line_number, output);
+        return;
     }
 
     ColorScheme::ConversionResult result = color_scheme.commands_to_color(placeholder);
@@ -66,33 +91,26 @@ std::string Parser::parse_placeholder(const std::string &format_path, const Colo
                       << "` at line: " << line_number;
         throw std::runtime_error(error_message.str());
     }
-    return result.result.to_string();
+    result.result.append_to(output);
 }
 
-std::string Parser::parse_ternary_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
-                                              const std::string &placeholder, int line_number) {
+void Parser::parse_ternary_placeholder(const std::string &format_path, const ColorScheme &color_scheme,
+                                       const std::string &placeholder, int line_number, std::string &output) {
     bool light_theme = color_scheme.is_light();
     if (placeholder.size() <= 5 || placeholder[5] != '?') {
         throw std::runtime_error("Invalid placeholder (missing '?'): `" + placeholder + "` in file: `" + format_path
                                  + "` at line: " + std::to_string(line_number));
     }
 
-    std::string options = placeholder.substr(6);
-    size_t colon_index = options.find(':');
+    size_t colon_index = placeholder.find(':', 6);
     if (colon_index == std::string::npos) {
         throw std::runtime_error("Invalid placeholder (missing ':'): `" + placeholder + "` in file: `" + format_path
                                  + "` at line: " + std::to_string(line_number));
     }
 
-    std::string string_1 = options.substr(0, colon_index);
-    std::string string_2;
-    if (colon_index + 1 < options.size()) {
-        string_2 = options.substr(colon_index + 1);
-    }
-
     if (light_theme) {
-        return string_1;
+        output.append(placeholder, 6, colon_index - 6);
     } else {
-        return string_2;
+        output.append(placeholder, colon_index + 1, std::string::npos);
     }
 }
@@ -0,0 +1,143 @@
+#include "self_check.h"
+
+#include <algorithm>
+#include <iomanip>
+#include "parser.h"
+#ifdef HUEMASTER_COUNT_ALLOCATIONS
+#include "allocation_counter.h"
+#endif
+
+namespace {
+    constexpr int transition_steps = 100;
+
+    // the targets enforce_contrast() keeps through a transition: text slots at the text target, the rest at the
+    // lower (light theme) color target, since the theme flips somewhere in the middle
+    constexpr float color_contrast = 3.0f;
+
+    Color bgr(float blue, float green, float red, float proportion) {
+        return {Vec3f(blue, green, red), proportion};
+    }
+}
+
+bool SelfCheck::run(std::ostream &out) {
+    std::vector<Palette> palettes = generate_palettes();
+
+    bool passed = check_transition_contrast(palettes, out);
+    if (!check_allocations(palettes, out)) {
+        passed = false;
+    }
+
+    out << (passed ? "PASS" : "FAIL") << std::endl;
+    return passed;
+}
+
+// Wallpaper-like palettes in BGR order, weighted towards the base tone the way extracted palettes are.
+std::vector<SelfCheck::Palette> SelfCheck::generate_palettes() {
+    return {
+            {"dark", {bgr(30, 20, 18, 0.55f), bgr(60, 45, 40, 0.15f), bgr(160, 90, 40, 0.1f),
+                      bgr(40, 60, 180, 0.08f), bgr(90, 170, 60, 0.07f), bgr(200, 200, 210, 0.05f)}, false},
+            {"light", {bgr(235, 240, 245, 0.5f), bgr(200, 210, 220, 0.2f), bgr(170, 120, 60, 0.1f),
+                       bgr(60, 80, 200, 0.1f), bgr(70, 140, 90, 0.06f), bgr(40, 40, 50, 0.04f)}, true},
+            // mid-grey backgrounds, where neither black nor white text has much room
+            {"dim", {bgr(85, 95, 100, 0.6f), bgr(120, 110, 100, 0.2f), bgr(50, 150, 200, 0.12f),
+                     bgr(150, 60, 120, 0.08f)}, false},
+            {"pale", {bgr(150, 160, 170, 0.6f), bgr(130, 140, 120, 0.2f), bgr(40, 110, 190, 0.12f),
+                      bgr(190, 120, 90, 0.08f)}, true},
+    };
+}
+
+// Every frame of a transition between two generated schemes, in both directions, has to keep the contrast targets;
+// the reported minimum is over all frames of all pairs.
+bool SelfCheck::check_transition_contrast(const std::vector<Palette> &palettes, std::ostream &out) {
+    std::vector<ColorScheme> schemes(palettes.size());
+    for (size_t i = 0; i < palettes.size(); i++) {
+        schemes[i].generate(palettes[i].colors, palettes[i].light);
+    }
+
+    struct SlotTarget {
+        const char *slot;
+        float contrast;
+    };
+    std::vector<SlotTarget> targets = {
+            {"FOREGROUND", ColorScheme::text_contrast},
+            {"COLOR7",     ColorScheme::text_contrast},
+            {"COLOR15",    ColorScheme::text_contrast},
+    };
+    for (const char *slot: {"COLOR1", "COLOR2", "COLOR3", "COLOR4", "COLOR5", "COLOR6", "ACCENT", "ERROR", "GOOD",
+                            "WARNING", "INFO"}) {
+        targets.push_back({slot, color_contrast});
+    }
+
+    bool passed = true;
+    std::vector<float> minimum(targets.size(), 21.0f);
+    for (size_t from = 0; from < schemes.size(); from++) {
+        for (size_t to = 0; to < schemes.size(); to++) {
+            if (from == to) {
+                continue;
+            }
+
+            for (int step = 0; step <= transition_steps; step++) {
+                float amount = (float) step / transition_steps;
+                ColorScheme frame = ColorScheme::interpolate(schemes[from], schemes[to], amount);
+                Color background = frame.name_to_color("BACKGROUND").result;
+
+                for (size_t i = 0; i < targets.size(); i++) {
+                    float contrast = frame.name_to_color(targets[i].slot).result.calculate_contrast(background);
+                    if (contrast < minimum[i]) {
+                        minimum[i] = contrast;
+                    }
+                    if (contrast < targets[i].contrast) {
+                        if (passed) {
+                            out << "transition " << palettes[from].name << " -> " << palettes[to].name << " at "
+                                << amount << ": " << targets[i].slot << " contrast " << contrast << " < "
+                                << targets[i].contrast << std::endl;
+                        }
+                        passed = false;
+                    }
+                }
+            }
+        }
+    }
+
+    out << "transition contrast minimum:";
+    for (size_t i = 0; i < targets.size(); i++) {
+        out << ' ' << targets[i].slot << ' ' << std::fixed << std::setprecision(2) << minimum[i];
+    }
+    out << std::defaultfloat << std::endl;
+    return passed;
+}
+
+// Generation and rendering reuse one ColorScheme and one output buffer; after a warm-up pass over the palettes they
+// must not allocate at all.
+bool SelfCheck::check_allocations(const std::vector<Palette> &palettes, std::ostream &out) {
+#ifdef HUEMASTER_COUNT_ALLOCATIONS
+    FormatTemplate format_template;
+    format_template.format_path = "<self-check>";
+    Parser::scan_line("background = $$BACKGROUND.HEXRGB$$, accent = $$ACCENT.lighten(20).alpha(-40).HEXRGBA$$\n",
+                      1, format_template);
+    Parser::scan_line("color9 = $$COLOR9.CRGB$$, theme = $$LIGHT?light:dark$$\n", 2, format_template);
+
+    ColorScheme color_scheme;
+    std::string output;
+    auto generate_and_render = [&] {
+        for (const Palette &palette: palettes) {
+            color_scheme.generate(palette.colors, palette.light);
+            output.clear();
+            Parser::render(format_template, color_scheme, output);
+        }
+    };
+
+    generate_and_render();
+    std::uint64_t before = AllocationCounter::thread_allocations();
+    generate_and_render();
+    std::uint64_t allocations = AllocationCounter::thread_allocations() - before;
+
+    out << "steady-state allocations: " << allocations << " in " << palettes.size()
+        << " generations and renders" << std::endl;
+    return allocations == 0;
+#else
+    (void) palettes;
+    out << "steady-state allocations: not counted (built without HUEMASTER_COUNT_ALLOCATIONS)" << std::endl;
+    return true;
+#endif
+}
@@ -0,0 +1,94 @@
+#include "worker_pool.h"
+
+#include <exception>
+#include <system_error>
+
+WorkerPool::WorkerPool(int threads) {
+    for (int t = 1; t < threads; t++) {
+        try {
+            workers.emplace_back(&WorkerPool::work, this);
+        } catch (const std::system_error &) {
+            break; // fewer threads only costs time, the calling thread picks up the rest
+        }
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::run(int count, const Job &job) {
+    if (workers.empty()) {
+        for (int index = 0; index < count; index++) {
+            job(index);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->count = count;
+        next = 0;
+        active = (int) workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    drain();
+
+    // every worker checks in once per run, so the next run cannot start while one is still draining this one
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return active == 0; });
+    this->job = nullptr;
+    std::exception_ptr thrown = nullptr;
+    std::swap(thrown, error);
+    lock.unlock();
+
+    if (thrown) {
+        std::rethrow_exception(thrown);
+    }
+}
+
+void WorkerPool::work() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        drain();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::drain() {
+    for (int index = next++; index < count; index = next++) {
+        try {
+            (*job)(index);
+        } catch (...) {
+            // an exception escaping a worker thread would terminate the program; run() rethrows it instead
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            next = count; // the run fails anyway, so the indices not yet started are skipped
+        }
+    }
+}
@@ -1,6 +1,54 @@
 #include "writer.h"
 
-void Writer::write(const std::string &real_path, const std::string &parsed_config) {
+#include <iterator>
+
+Writer::FileState Writer::stat(const std::string &real_path) {
+    std::error_code error;
+    std::uintmax_t size = std::filesystem::file_size(real_path, error);
+    if (error) {
+        return {};
+    }
+
+    FileState state;
+    state.exists = true;
+    state.size = size;
+    state.modified = std::filesystem::last_write_time(real_path, error);
+    return state;
+}
+
+std::uint64_t Writer::hash(const std::string &content) {
+    // FNV-1a
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char byte: content) {
+        hash = (hash ^ byte) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool Writer::write(const std::string &real_path, const std::string &parsed_config) {
+    FileState state = stat(real_path);
+    return write(real_path, parsed_config, hash(parsed_config), state);
+}
+
+bool Writer::write(const std::string &real_path, const std::string &parsed_config, std::uint64_t content_hash,
+                   FileState &state) {
+    // only same-sized files can be unchanged; a known hash settles it, otherwise the file is read back once
+    if (state.exists && state.size == parsed_config.size()) {
+        if (state.hash_known && state.content_hash == content_hash) {
+            return false;
+        }
+
+        if (!state.hash_known) {
+            std::ifstream existing(real_path, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+            if (existing.is_open() && content == parsed_config) {
+                state.hash_known = true;
+                state.content_hash = content_hash;
+                return false;
+            }
+        }
+    }
+
     std::ofstream file(real_path);
 
     if (!file.is_open()) {
@@ -10,4 +58,9 @@ void Writer::write(const std::string &real_path, const std::string &parsed_confi
     file << parsed_config;
 
     file.close();
+
+    state = stat(real_path);
+    state.hash_known = true;
+    state.content_hash = content_hash;
+    return true;
 }
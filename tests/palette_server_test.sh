@@ -0,0 +1,103 @@
+#!/bin/sh
+# Starts `huemaster --serve` on a temporary socket, checks the protocol through `huemaster --query` (including that
+# queries keep being answered during a WALLPAPER switch) and stops the server with SIGTERM.
+#
+# usage: palette_server_test.sh <huemaster> <directory with dark.png and light.png>
+
+huemaster=$1
+data=$(cd "$2" && pwd)
+
+work=$(mktemp -d)
+server=
+cleanup() {
+    if [ -n "$server" ]; then
+        kill -TERM "$server" 2>/dev/null
+    fi
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+export HOME="$work/home"
+export XDG_CACHE_HOME="$work/cache"
+mkdir -p "$HOME/.config/huemaster"
+printf 'background = $$BACKGROUND.HEXRGB$$\n' > "$work/colors.format"
+cat > "$HOME/.config/huemaster/config.toml" <<EOF
+[Wallpaper]
+path = "$data/dark.png"
+
+[colors]
+format_path = "$work/colors.format"
+real_path = "$work/colors.out"
+EOF
+
+socket="$work/huemaster.sock"
+# the transition makes a WALLPAPER switch take about two seconds, long enough to query the server during it
+"$huemaster" --serve --socket "$socket" --transition-frames 20 --transition-fps 10 2>"$work/server.log" &
+server=$!
+
+for attempt in $(seq 100); do
+    [ -S "$socket" ] && break
+    kill -0 "$server" 2>/dev/null || fail "server exited during startup: $(cat "$work/server.log")"
+    sleep 0.1
+done
+[ -S "$socket" ] || fail "server did not create $socket"
+
+query() {
+    "$huemaster" --query --socket "$socket" "$@"
+}
+
+background=$(query 'EVAL BACKGROUND.HEXRGB') || fail "EVAL failed"
+echo "$background" | grep -Eq '^#[0-9a-f]{6}$' || fail "EVAL returned '$background'"
+
+query DUMP > "$work/dump" || fail "DUMP failed"
+head -n 1 "$work/dump" | grep -Eq '^THEME (light|dark)$' || fail "DUMP does not start with the theme"
+grep -q "^BACKGROUND $background\$" "$work/dump" || fail "DUMP disagrees with EVAL"
+
+rendered=$(query "RENDER $work/colors.format") || fail "RENDER failed"
+[ "$rendered" = "background = $background" ] || fail "RENDER returned '$rendered'"
+[ "$(cat "$work/colors.out")" = "$rendered" ] || fail "RENDER differs from the written file"
+
+if query 'EVAL NOT_A_SLOT' 'BOGUS' > "$work/errors.out" 2> "$work/errors.err"; then
+    fail "invalid requests did not fail"
+fi
+[ "$(wc -l < "$work/errors.err")" -eq 2 ] || fail "expected two ERR responses, got: $(cat "$work/errors.err")"
+
+# pipelined requests are answered in order
+pipelined=$(query 'EVAL BACKGROUND.HEXRGB' 'EVAL BACKGROUND.CRGB' 'EVAL BACKGROUND.HEXRGB' | sed -n '1p;3p' | uniq)
+[ "$pipelined" = "$background" ] || fail "pipelined responses out of order"
+
+query "WALLPAPER $data/light.png" > "$work/switch.out" 2>&1 &
+switch=$!
+sleep 0.5
+kill -0 "$switch" 2>/dev/null || fail "WALLPAPER finished too quickly to test queries during it"
+
+start=$(now_ms)
+during=$(query 'EVAL BACKGROUND.HEXRGB') || fail "EVAL failed during a WALLPAPER switch"
+elapsed=$(($(now_ms) - start))
+[ "$during" = "$background" ] || fail "the old scheme was not served during the switch"
+[ "$elapsed" -lt 1000 ] || fail "EVAL took $elapsed ms during a WALLPAPER switch"
+
+wait "$switch" || fail "WALLPAPER failed: $(cat "$work/switch.out")"
+[ "$(cat "$work/switch.out")" = "$data/light.png" ] || fail "WALLPAPER returned '$(cat "$work/switch.out")'"
+after=$(query 'EVAL BACKGROUND.HEXRGB') || fail "EVAL failed after the switch"
+[ "$after" != "$background" ] || fail "the scheme did not change after WALLPAPER"
+
+query "WALLPAPER $work/missing.png" 2>/dev/null && fail "WALLPAPER of a missing file succeeded"
+
+kill -TERM "$server"
+wait "$server"
+status=$?
+server=
+[ "$status" -eq 0 ] || fail "server exited with status $status after SIGTERM"
+[ -e "$socket" ] && fail "server left its socket behind"
+
+echo "palette server: all checks passed"